@@ -35,10 +35,6 @@ fi
 
 curl -L -o "$icon_dir/$ICONNAME.ico" "$SERVICE_URL"
 
-if command -v convert >/dev/null 2>&1; then
-  convert "$icon_dir/$ICONNAME.ico[0]" -resize 32x32 "$icon_dir/$ICONNAME.png"
-elif command -v magick >/dev/null 2>&1; then
-  magick "$icon_dir/$ICONNAME.ico[0]" -resize 32x32 "$icon_dir/$ICONNAME.png"
-else
-  echo "No ImageMagick found; keeping .ico files only." >&2
-fi
\ No newline at end of file
+# selaction decodes .ico files itself (best sub-image, scaled per screen), so no
+# conversion is needed; point an action's "icon" at the file.
+echo "$icon_dir/$ICONNAME.ico"
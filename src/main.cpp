@@ -1,37 +1,85 @@
 #include <QApplication>
+#include <QCborArray>
+#include <QCborMap>
+#include <QCborValue>
 #include <QClipboard>
+#include <QCommandLineParser>
+#include <QCoreApplication>
 #include <QCursor>
+#include <QDateTime>
 #include <QDesktopServices>
 #include <QDir>
 #include <QFile>
 #include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QFuture>
+#include <QFutureWatcher>
 #include <QGuiApplication>
+#include <QImageReader>
+#include <QHash>
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QMimeData>
 #include <QProcess>
+#include <QQueue>
 #include <QElapsedTimer>
 #include <QRegularExpression>
+#include <QSaveFile>
 #include <QScreen>
+#include <QSet>
 #include <QStandardPaths>
+#include <QThread>
 #include <QTimer>
 #include <QUrl>
 #include <QDebug>
 #include <QGridLayout>
 #include <QKeyEvent>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QLockFile>
 #include <QStyle>
 #include <QToolButton>
+#include <QtConcurrent>
+#include <QtAlgorithms>
 #include <QtGlobal>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <coroutine>
 #include <cstdio>
+#include <cstring>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+
+#include <unistd.h>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "selaction_digest.h"
+#include "selaction_history.h"
+#include "selaction_json.h"
+#include "selaction_text.h"
 
 namespace {
 
+using selaction::text::ClipboardHistory;
+using selaction::text::HistorySearchIndex;
+using selaction::text::textFingerprint;
+
 struct ExternalAction {
     QString label;
     QString command;
-    QStringList args;
+    // Each argument pre-split at its {text} placeholders.
+    QList<QStringList> argTemplates;
     QString icon;
 };
 
@@ -42,6 +90,9 @@ struct MenuAction {
     QString icon;
 };
 
+// Bump whenever the layout of cached settings or actions changes.
+constexpr int kConfigCacheVersion = 2;
+
 struct AppSettings {
     bool pollEnabled = false;
     int pollIntervalMs = 1500;
@@ -49,25 +100,107 @@ struct AppSettings {
     QString wlPasteMode = "primary";
     int actionIconsPerRow = 10;
     QString logLevel = "info";
+    int historyBytes = 4 * 1024 * 1024;
+    bool historyPersist = false;
+    bool historyCompress = false;
+    int idleCompactSeconds = 120;
+    bool idleDropPopup = false;
 };
 
-QString normalizeWhitespace(const QString &text) {
-    QString result = text;
-    result.replace(QRegularExpression("\\s+"), " ");
-    return result.trimmed();
+QString configCachePath() {
+    const QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation);
+    return cacheDir + "/selaction/config.cbor";
+}
+
+QCborMap configSourceStamp(const QFileInfo &source) {
+    QCborMap stamp;
+    stamp.insert(QStringLiteral("path"), source.absoluteFilePath());
+    stamp.insert(QStringLiteral("mtime_ms"), source.lastModified().toMSecsSinceEpoch());
+    stamp.insert(QStringLiteral("size"), source.size());
+    return stamp;
+}
+
+// Compiled config cache: one CBOR map with a section per source file, each
+// holding the parsed result and the mtime/size of the file it came from. A
+// section is only used while its source is unchanged.
+QCborMap readConfigCache() {
+    QFile file(configCachePath());
+    if (!file.open(QIODevice::ReadOnly) || file.size() == 0) {
+        return QCborMap();
+    }
+    const uchar *data = file.map(0, file.size());
+    const QByteArray bytes = data ? QByteArray::fromRawData(reinterpret_cast<const char *>(data), file.size())
+                                  : file.readAll();
+    const QCborMap cache = QCborValue::fromCbor(bytes).toMap();
+    if (cache.value(QStringLiteral("version")).toInteger() != kConfigCacheVersion) {
+        return QCborMap();
+    }
+    return cache;
+}
+
+QCborValue cachedConfigSection(const QString &section, const QFileInfo &source) {
+    const QCborMap entry = readConfigCache().value(section).toMap();
+    if (entry.value(QStringLiteral("source")).toMap() != configSourceStamp(source)) {
+        return QCborValue();
+    }
+    return entry.value(QStringLiteral("data"));
+}
+
+void storeConfigSection(const QString &section, const QFileInfo &source, const QCborValue &data) {
+    QCborMap cache = readConfigCache();
+    cache.insert(QStringLiteral("version"), kConfigCacheVersion);
+    QCborMap entry;
+    entry.insert(QStringLiteral("source"), configSourceStamp(source));
+    entry.insert(QStringLiteral("data"), data);
+    cache.insert(section, entry);
+
+    const QString path = configCachePath();
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return;
+    }
+    file.write(cache.toCborValue().toCbor());
+    if (!file.commit()) {
+        qWarning() << "Cannot write config cache" << path;
+    }
+}
+
+QCborValue externalActionsToCbor(const QList<ExternalAction> &actions) {
+    QCborArray list;
+    for (const ExternalAction &action : actions) {
+        QCborArray args;
+        for (const QStringList &parts : action.argTemplates) {
+            args.append(QCborArray::fromStringList(parts));
+        }
+        QCborMap entry;
+        entry.insert(QStringLiteral("label"), action.label);
+        entry.insert(QStringLiteral("command"), action.command);
+        entry.insert(QStringLiteral("args"), args);
+        entry.insert(QStringLiteral("icon"), action.icon);
+        list.append(entry);
+    }
+    return list;
 }
 
-QString toTitleCase(const QString &text) {
-    QStringList parts = normalizeWhitespace(text).split(' ', Qt::SkipEmptyParts);
-    for (QString &part : parts) {
-        if (!part.isEmpty()) {
-            part[0] = part[0].toUpper();
-            if (part.size() > 1) {
-                part = part[0] + part.mid(1).toLower();
+QList<ExternalAction> externalActionsFromCbor(const QCborValue &value) {
+    QList<ExternalAction> actions;
+    for (const QCborValue &item : value.toArray()) {
+        const QCborMap entry = item.toMap();
+        ExternalAction action;
+        action.label = entry.value(QStringLiteral("label")).toString();
+        action.command = entry.value(QStringLiteral("command")).toString();
+        for (const QCborValue &arg : entry.value(QStringLiteral("args")).toArray()) {
+            QStringList parts;
+            for (const QCborValue &part : arg.toArray()) {
+                parts.append(part.toString());
             }
+            action.argTemplates.append(parts);
         }
+        action.icon = entry.value(QStringLiteral("icon")).toString();
+        actions.append(action);
     }
-    return parts.join(' ');
+    return actions;
 }
 
 QList<ExternalAction> loadExternalActions() {
@@ -75,6 +208,16 @@ QList<ExternalAction> loadExternalActions() {
     const QString configDir = QStandardPaths::writableLocation(QStandardPaths::ConfigLocation);
     const QString configPath = configDir + "/selaction/actions.json";
 
+    const QFileInfo source(configPath);
+    if (source.exists()) {
+        const QCborValue cached = cachedConfigSection(QStringLiteral("actions"), source);
+        if (cached.isArray()) {
+            actions = externalActionsFromCbor(cached);
+            qInfo() << "Loaded external actions from cache:" << actions.size();
+            return actions;
+        }
+    }
+
     QFile file(configPath);
     if (!file.open(QIODevice::ReadOnly)) {
         qInfo() << "No external actions config at" << configPath;
@@ -100,28 +243,524 @@ QList<ExternalAction> loadExternalActions() {
         action.label = label;
         action.command = command;
         for (const QJsonValue &arg : obj.value("args").toArray()) {
-            action.args.append(arg.toString());
+            action.argTemplates.append(arg.toString().split("{text}"));
         }
         action.icon = obj.value("icon").toString();
         actions.append(action);
     }
 
     qInfo() << "Loaded external actions:" << actions.size();
+    storeConfigSection(QStringLiteral("actions"), source, externalActionsToCbor(actions));
 
     return actions;
 }
 
-QStringList expandArgs(const QStringList &args, const QString &text) {
+QStringList expandArgs(const QList<QStringList> &argTemplates, const QString &text) {
     QStringList expanded;
-    expanded.reserve(args.size());
-    for (const QString &arg : args) {
-        QString out = arg;
-        out.replace("{text}", text);
-        expanded.append(out);
+    expanded.reserve(argTemplates.size());
+    for (const QStringList &parts : argTemplates) {
+        expanded.append(parts.join(text));
     }
     return expanded;
 }
 
+bool matchesActionFilter(const QString &label, const QString &filter) {
+    // Subsequence match: every filter character must appear in order.
+    int pos = 0;
+    for (const QChar ch : filter) {
+        pos = label.indexOf(ch, pos);
+        if (pos < 0) {
+            return false;
+        }
+        ++pos;
+    }
+    return true;
+}
+
+// Immutable, reference-counted text handed around by handle between the
+// controller, popup actions, history and worker threads. It keeps the encoding
+// its source produced and derives the other view, the fingerprint and the
+// feature bits on first use; every derived value is computed at most once and
+// is safe to read from any thread.
+class SharedText {
+public:
+    enum Feature : quint32 {
+        Ascii = 0x1,
+        Multiline = 0x2,
+    };
+
+    SharedText() = default;
+
+    static SharedText fromUtf8(const QByteArray &utf8) {
+        SharedText shared;
+        auto data = std::make_shared<Data>();
+        data->utf8 = utf8;
+        // The source encoding is already present; mark it so it is never derived.
+        std::call_once(data->utf8Once, []() {});
+        shared.d_ = std::move(data);
+        return shared;
+    }
+
+    static SharedText fromString(const QString &text) {
+        SharedText shared;
+        auto data = std::make_shared<Data>();
+        data->utf16 = text;
+        std::call_once(data->utf16Once, []() {});
+        shared.d_ = std::move(data);
+        return shared;
+    }
+
+    bool isNull() const {
+        return !d_;
+    }
+
+    bool isEmpty() const {
+        return !d_ || utf8().isEmpty();
+    }
+
+    const QString &text() const {
+        static const QString empty;
+        if (!d_) {
+            return empty;
+        }
+        std::call_once(d_->utf16Once, [this]() { d_->utf16 = QString::fromUtf8(d_->utf8); });
+        return d_->utf16;
+    }
+
+    const QByteArray &utf8() const {
+        static const QByteArray empty;
+        if (!d_) {
+            return empty;
+        }
+        std::call_once(d_->utf8Once, [this]() { d_->utf8 = d_->utf16.toUtf8(); });
+        return d_->utf8;
+    }
+
+    quint64 fingerprint() const {
+        if (!d_) {
+            return textFingerprint(QByteArrayView());
+        }
+        std::call_once(d_->fingerprintOnce, [this]() { d_->fingerprint = textFingerprint(utf8()); });
+        return d_->fingerprint;
+    }
+
+    quint32 features() const {
+        if (!d_) {
+            return Ascii;
+        }
+        std::call_once(d_->featuresOnce, [this]() {
+            const QByteArray &bytes = utf8();
+            quint32 features = Ascii;
+            for (const char ch : bytes) {
+                if (static_cast<uchar>(ch) >= 0x80) {
+                    features &= ~quint32(Ascii);
+                }
+                if (ch == '\n') {
+                    features |= Multiline;
+                }
+            }
+            d_->features = features;
+        });
+        return d_->features;
+    }
+
+    bool has(Feature feature) const {
+        return (features() & feature) != 0;
+    }
+
+private:
+    struct Data {
+        std::once_flag utf16Once;
+        std::once_flag utf8Once;
+        std::once_flag fingerprintOnce;
+        std::once_flag featuresOnce;
+        QString utf16;
+        QByteArray utf8;
+        quint64 fingerprint = 0;
+        quint32 features = 0;
+    };
+
+    std::shared_ptr<Data> d_;
+};
+
+// Clipboard payload backed by a SharedText. Nothing is encoded until a reader
+// asks for a format; the UTF-8 bytes are the handle's own cached view, so they
+// are produced at most once and shared with the history.
+class SharedTextMimeData : public QMimeData {
+public:
+    explicit SharedTextMimeData(SharedText text)
+        : text_(std::move(text)) {}
+
+    QStringList formats() const override {
+        return {QStringLiteral("text/plain;charset=utf-8"), QStringLiteral("text/plain")};
+    }
+
+    bool hasFormat(const QString &mimeType) const override {
+        return formats().contains(mimeType);
+    }
+
+protected:
+    QVariant retrieveData(const QString &mimeType, QMetaType type) const override {
+        if (!hasFormat(mimeType)) {
+            return QVariant();
+        }
+        if (type.id() == QMetaType::QString) {
+            return text_.text();
+        }
+        return text_.utf8();
+    }
+
+private:
+    SharedText text_;
+};
+
+// On-disk history: payloads are appended to history.log and described by
+// fixed-width records in history.idx. Startup maps both files and only reads
+// the newest payloads that fit into the in-memory budget. Re-seen texts append
+// a record pointing at the existing payload, and dead records are dropped by a
+// compaction that runs on a worker thread. Appends are buffered and written
+// in one batch per flush interval so bursts of changes cost one write each.
+class HistoryLog : public QObject {
+    Q_OBJECT
+
+public:
+    struct Record {
+        quint64 offset = 0;
+        quint32 length = 0;
+        quint32 flags = 0;
+        quint64 fingerprint = 0;
+        qint64 timestampMs = 0;
+    };
+    static_assert(sizeof(Record) == 32, "history index records must stay fixed width");
+
+    struct LoadedEntry {
+        QByteArray utf8;
+        qint64 timestampMs = 0;
+    };
+
+    explicit HistoryLog(QObject *parent = nullptr)
+        : QObject(parent) {
+        flushTimer_.setSingleShot(true);
+        flushTimer_.setInterval(kFlushDelayMs);
+        connect(&flushTimer_, &QTimer::timeout, this, &HistoryLog::flush);
+    }
+
+    ~HistoryLog() override {
+        flush();
+        if (compactor_) {
+            compactor_->wait();
+            delete compactor_;
+        }
+    }
+
+    bool open(const QString &dirPath) {
+        if (!QDir().mkpath(dirPath)) {
+            qWarning() << "History: cannot create" << dirPath;
+            return false;
+        }
+        logPath_ = dirPath + "/history.log";
+        indexPath_ = dirPath + "/history.idx";
+        return openFiles();
+    }
+
+    bool isOpen() const {
+        return logFile_.isOpen() && indexFile_.isOpen();
+    }
+
+    void setCompression(bool enabled) {
+        compress_ = enabled;
+    }
+
+    qint64 diskBytes() const {
+        return logSize_ + kHeaderSize + recordCount_ * qint64(sizeof(Record));
+    }
+
+    // Newest entries that fit into budget bytes, returned oldest first.
+    QList<LoadedEntry> load(qsizetype budget) {
+        QList<LoadedEntry> loaded;
+        flush();
+        if (!isOpen() || recordCount_ == 0 || logSize_ == 0) {
+            return loaded;
+        }
+        QFile index(indexPath_);
+        QFile log(logPath_);
+        if (!index.open(QIODevice::ReadOnly) || !log.open(QIODevice::ReadOnly)) {
+            return loaded;
+        }
+        const uchar *indexData = index.map(0, kHeaderSize + recordCount_ * qint64(sizeof(Record)));
+        const uchar *logData = log.map(0, logSize_);
+        if (!indexData || !logData) {
+            qWarning() << "History: cannot map" << indexPath_;
+            return loaded;
+        }
+
+        QSet<quint64> seen;
+        qsizetype used = 0;
+        for (qint64 i = recordCount_ - 1; i >= 0; --i) {
+            Record record;
+            std::memcpy(&record, indexData + kHeaderSize + i * qint64(sizeof(Record)), sizeof(Record));
+            if (seen.contains(record.fingerprint)) {
+                continue;
+            }
+            seen.insert(record.fingerprint);
+            if (record.offset + record.length > quint64(logSize_)) {
+                continue;
+            }
+            QByteArray payload(reinterpret_cast<const char *>(logData + record.offset), record.length);
+            if (record.flags & kCompressed) {
+                payload = qUncompress(payload);
+            }
+            if (payload.isEmpty()) {
+                continue;
+            }
+            if (used + payload.size() > budget) {
+                break;
+            }
+            used += payload.size();
+            refs_.insert(record.fingerprint, record);
+            loaded.append({payload, record.timestampMs});
+        }
+        std::reverse(loaded.begin(), loaded.end());
+        return loaded;
+    }
+
+    void append(quint64 fingerprint, const QByteArray &utf8, qint64 timestampMs) {
+        if (!isOpen()) {
+            return;
+        }
+        if (compactor_) {
+            pending_.append({fingerprint, utf8, timestampMs});
+            return;
+        }
+
+        Record record;
+        const auto found = refs_.constFind(fingerprint);
+        if (found != refs_.constEnd()) {
+            record = found.value();
+        } else {
+            QByteArray payload = utf8;
+            if (compress_ && utf8.size() >= kCompressMinBytes) {
+                const QByteArray packed = qCompress(utf8);
+                if (packed.size() < utf8.size()) {
+                    payload = packed;
+                    record.flags |= kCompressed;
+                }
+            }
+            logBuffer_.append(payload);
+            record.offset = quint64(logSize_);
+            record.length = quint32(payload.size());
+            record.fingerprint = fingerprint;
+            logSize_ += payload.size();
+        }
+        record.timestampMs = timestampMs;
+        indexBuffer_.append(reinterpret_cast<const char *>(&record), sizeof(Record));
+        refs_.insert(fingerprint, record);
+        ++recordCount_;
+        if (!flushTimer_.isActive()) {
+            flushTimer_.start();
+        }
+    }
+
+    // Writes buffered payloads before their index records, so a crash between
+    // the two leaves unreferenced payload bytes rather than dangling records.
+    void flush() {
+        flushTimer_.stop();
+        if (!isOpen() || (logBuffer_.isEmpty() && indexBuffer_.isEmpty())) {
+            return;
+        }
+        const bool ok = logFile_.write(logBuffer_) == logBuffer_.size() && logFile_.flush()
+            && indexFile_.write(indexBuffer_) == indexBuffer_.size() && indexFile_.flush();
+        logBuffer_.clear();
+        indexBuffer_.clear();
+        if (!ok) {
+            qWarning() << "History: write failed" << logPath_;
+            // Resynchronise sizes and references with what actually reached disk.
+            logFile_.close();
+            indexFile_.close();
+            refs_.clear();
+            openFiles();
+        }
+    }
+
+    void close() {
+        flush();
+        if (compactor_) {
+            // Its result would reopen the files; finish it and throw it away.
+            disconnect(compactor_, nullptr, this, nullptr);
+            compactor_->wait();
+            delete compactor_;
+            compactor_ = nullptr;
+            QFile::remove(logPath_ + ".compact");
+            QFile::remove(indexPath_ + ".compact");
+            pending_.clear();
+        }
+        logFile_.close();
+        indexFile_.close();
+        refs_.clear();
+    }
+
+    bool needsCompaction(int liveEntries) const {
+        return isOpen() && !compactor_ && recordCount_ >= kCompactMinRecords
+            && recordCount_ > 2 * qint64(liveEntries);
+    }
+
+    void compact(const QList<quint64> &liveOldestFirst) {
+        if (!isOpen() || compactor_) {
+            return;
+        }
+        flush();
+        QList<Record> keep;
+        QHash<quint64, Record> liveRefs;
+        for (const quint64 fingerprint : liveOldestFirst) {
+            const auto found = refs_.constFind(fingerprint);
+            if (found != refs_.constEnd()) {
+                keep.append(found.value());
+                liveRefs.insert(fingerprint, found.value());
+            }
+        }
+        refs_ = liveRefs;
+
+        struct Result {
+            bool ok = false;
+            QList<Record> records;
+        };
+        auto result = std::make_shared<Result>();
+        const QString logPath = logPath_;
+        const QString indexPath = indexPath_;
+        const qint64 recordsBefore = recordCount_;
+        compactor_ = QThread::create([logPath, indexPath, keep, result]() {
+            QFile source(logPath);
+            QFile log(logPath + ".compact");
+            QFile index(indexPath + ".compact");
+            if (!source.open(QIODevice::ReadOnly) || !log.open(QIODevice::WriteOnly | QIODevice::Truncate)
+                || !index.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+                return;
+            }
+            const qint64 sourceSize = source.size();
+            const uchar *data = sourceSize > 0 ? source.map(0, sourceSize) : nullptr;
+            if (!data || index.write(kIndexMagic, kHeaderSize) != kHeaderSize) {
+                return;
+            }
+            quint64 offset = 0;
+            for (Record record : keep) {
+                if (record.offset + record.length > quint64(sourceSize)) {
+                    continue;
+                }
+                if (log.write(reinterpret_cast<const char *>(data + record.offset), record.length) != qint64(record.length)) {
+                    return;
+                }
+                record.offset = offset;
+                offset += record.length;
+                if (index.write(reinterpret_cast<const char *>(&record), sizeof(Record)) != qint64(sizeof(Record))) {
+                    return;
+                }
+                result->records.append(record);
+            }
+            result->ok = log.flush() && index.flush();
+        });
+        connect(compactor_, &QThread::finished, this, [this, result, recordsBefore]() {
+            compactor_->deleteLater();
+            compactor_ = nullptr;
+            const QString compactLog = logPath_ + ".compact";
+            const QString compactIndex = indexPath_ + ".compact";
+            if (result->ok) {
+                logFile_.close();
+                indexFile_.close();
+                const bool renamed =
+                    std::rename(QFile::encodeName(compactLog).constData(), QFile::encodeName(logPath_).constData()) == 0
+                    && std::rename(QFile::encodeName(compactIndex).constData(), QFile::encodeName(indexPath_).constData()) == 0;
+                refs_.clear();
+                if (renamed) {
+                    for (const Record &record : result->records) {
+                        refs_.insert(record.fingerprint, record);
+                    }
+                    qInfo() << "History: compacted records" << recordsBefore << "->" << result->records.size();
+                } else {
+                    qWarning() << "History: compaction rename failed; resetting log";
+                    QFile::remove(logPath_);
+                    QFile::remove(indexPath_);
+                }
+                openFiles();
+            } else {
+                qWarning() << "History: compaction failed";
+            }
+            QFile::remove(compactLog);
+            QFile::remove(compactIndex);
+
+            const QList<PendingAppend> pending = std::move(pending_);
+            pending_.clear();
+            for (const PendingAppend &entry : pending) {
+                append(entry.fingerprint, entry.utf8, entry.timestampMs);
+            }
+        });
+        compactor_->start();
+    }
+
+private:
+    struct PendingAppend {
+        quint64 fingerprint = 0;
+        QByteArray utf8;
+        qint64 timestampMs = 0;
+    };
+
+    static constexpr char kIndexMagic[] = "SELHIDX1";
+    static constexpr qint64 kHeaderSize = 8;
+    static constexpr quint32 kCompressed = 0x1;
+    static constexpr qsizetype kCompressMinBytes = 256;
+    static constexpr qint64 kCompactMinRecords = 512;
+    static constexpr int kFlushDelayMs = 1000;
+
+    bool openFiles() {
+        QFile header(indexPath_);
+        if (header.open(QIODevice::ReadOnly) && header.size() > 0
+            && header.read(kHeaderSize) != QByteArray(kIndexMagic, kHeaderSize)) {
+            qWarning() << "History: discarding unreadable index" << indexPath_;
+            header.close();
+            QFile::remove(indexPath_);
+            QFile::remove(logPath_);
+        }
+        header.close();
+
+        logFile_.setFileName(logPath_);
+        indexFile_.setFileName(indexPath_);
+        if (!logFile_.open(QIODevice::ReadWrite | QIODevice::Append)
+            || !indexFile_.open(QIODevice::ReadWrite | QIODevice::Append)) {
+            qWarning() << "History: cannot open" << logPath_;
+            logFile_.close();
+            indexFile_.close();
+            return false;
+        }
+
+        if (indexFile_.size() < kHeaderSize) {
+            indexFile_.resize(0);
+            logFile_.resize(0);
+            indexFile_.write(kIndexMagic, kHeaderSize);
+            indexFile_.flush();
+        }
+        // Drop a torn trailing record left by a crash mid-write.
+        recordCount_ = (indexFile_.size() - kHeaderSize) / qint64(sizeof(Record));
+        if (indexFile_.size() != kHeaderSize + recordCount_ * qint64(sizeof(Record))) {
+            indexFile_.resize(kHeaderSize + recordCount_ * qint64(sizeof(Record)));
+        }
+        logSize_ = logFile_.size();
+        return true;
+    }
+
+    QString logPath_;
+    QString indexPath_;
+    QFile logFile_;
+    QFile indexFile_;
+    qint64 logSize_ = 0;
+    qint64 recordCount_ = 0;
+    bool compress_ = false;
+    QHash<quint64, Record> refs_;
+    QThread *compactor_ = nullptr;
+    QList<PendingAppend> pending_;
+    QByteArray logBuffer_;
+    QByteArray indexBuffer_;
+    QTimer flushTimer_;
+};
+
 QString previewText(const QString &text) {
     QString preview = text;
     preview.replace("\n", "\\n");
@@ -132,11 +771,53 @@ QString previewText(const QString &text) {
     return preview;
 }
 
+QCborValue settingsToCbor(const AppSettings &settings) {
+    QCborMap map;
+    map.insert(QStringLiteral("poll"), settings.pollEnabled);
+    map.insert(QStringLiteral("poll_ms"), settings.pollIntervalMs);
+    map.insert(QStringLiteral("wlpaste"), settings.wlPasteEnabled);
+    map.insert(QStringLiteral("wlpaste_mode"), settings.wlPasteMode);
+    map.insert(QStringLiteral("icons_per_row"), settings.actionIconsPerRow);
+    map.insert(QStringLiteral("log_level"), settings.logLevel);
+    map.insert(QStringLiteral("history_bytes"), settings.historyBytes);
+    map.insert(QStringLiteral("history_persist"), settings.historyPersist);
+    map.insert(QStringLiteral("history_compress"), settings.historyCompress);
+    map.insert(QStringLiteral("idle_compact_s"), settings.idleCompactSeconds);
+    map.insert(QStringLiteral("idle_drop_popup"), settings.idleDropPopup);
+    return map;
+}
+
+AppSettings settingsFromCbor(const QCborValue &value) {
+    const QCborMap map = value.toMap();
+    AppSettings settings;
+    settings.pollEnabled = map.value(QStringLiteral("poll")).toBool(settings.pollEnabled);
+    settings.pollIntervalMs = int(map.value(QStringLiteral("poll_ms")).toInteger(settings.pollIntervalMs));
+    settings.wlPasteEnabled = map.value(QStringLiteral("wlpaste")).toBool(settings.wlPasteEnabled);
+    settings.wlPasteMode = map.value(QStringLiteral("wlpaste_mode")).toString(settings.wlPasteMode);
+    settings.actionIconsPerRow = int(map.value(QStringLiteral("icons_per_row")).toInteger(settings.actionIconsPerRow));
+    settings.logLevel = map.value(QStringLiteral("log_level")).toString(settings.logLevel);
+    settings.historyBytes = int(map.value(QStringLiteral("history_bytes")).toInteger(settings.historyBytes));
+    settings.historyPersist = map.value(QStringLiteral("history_persist")).toBool(settings.historyPersist);
+    settings.historyCompress = map.value(QStringLiteral("history_compress")).toBool(settings.historyCompress);
+    settings.idleCompactSeconds = int(map.value(QStringLiteral("idle_compact_s")).toInteger(settings.idleCompactSeconds));
+    settings.idleDropPopup = map.value(QStringLiteral("idle_drop_popup")).toBool(settings.idleDropPopup);
+    return settings;
+}
+
 AppSettings loadSettings() {
     AppSettings settings;
     const QString configDir = QStandardPaths::writableLocation(QStandardPaths::ConfigLocation);
     const QString configPath = configDir + "/selaction/settings.json";
 
+    const QFileInfo source(configPath);
+    if (source.exists()) {
+        const QCborValue cached = cachedConfigSection(QStringLiteral("settings"), source);
+        if (cached.isMap()) {
+            qInfo() << "Loaded settings from cache for" << configPath;
+            return settingsFromCbor(cached);
+        }
+    }
+
     QFile file(configPath);
     if (!file.open(QIODevice::ReadOnly)) {
         qInfo() << "No settings config at" << configPath;
@@ -184,6 +865,27 @@ AppSettings loadSettings() {
             settings.actionIconsPerRow = parsed;
         }
     }
+    if (obj.contains("history_bytes")) {
+        const int value = obj.value("history_bytes").toInt(settings.historyBytes);
+        if (value >= 0) {
+            settings.historyBytes = value;
+        }
+    }
+    if (obj.contains("history_persist")) {
+        settings.historyPersist = obj.value("history_persist").toBool(settings.historyPersist);
+    }
+    if (obj.contains("history_compress")) {
+        settings.historyCompress = obj.value("history_compress").toBool(settings.historyCompress);
+    }
+    if (obj.contains("idle_compact_s")) {
+        const int value = obj.value("idle_compact_s").toInt(settings.idleCompactSeconds);
+        if (value >= 0) {
+            settings.idleCompactSeconds = value;
+        }
+    }
+    if (obj.contains("idle_drop_popup")) {
+        settings.idleDropPopup = obj.value("idle_drop_popup").toBool(settings.idleDropPopup);
+    }
     if (obj.contains("log_level")) {
         const QJsonValue value = obj.value("log_level");
         const QString level = value.toString(settings.logLevel).toLower();
@@ -193,10 +895,150 @@ AppSettings loadSettings() {
     }
 
     qInfo() << "Loaded settings from" << configPath;
+    storeConfigSection(QStringLiteral("settings"), source, settingsToCbor(settings));
     return settings;
 }
 
-QString readWlPaste(const QStringList &args, int timeoutMs, bool *ok) {
+// Environment variables win over settings.json, on startup and on reload.
+AppSettings withEnvironmentOverrides(const AppSettings &settings) {
+    AppSettings effective = settings;
+    if (qEnvironmentVariableIsSet("SELACTION_POLL")) {
+        effective.pollEnabled = true;
+    }
+    if (qEnvironmentVariableIsSet("SELACTION_POLL_MS")) {
+        const int value = qEnvironmentVariableIntValue("SELACTION_POLL_MS");
+        if (value > 0) {
+            effective.pollIntervalMs = value;
+        }
+    }
+    if (qEnvironmentVariableIsSet("SELACTION_WLPASTE")) {
+        effective.wlPasteEnabled = true;
+    }
+    if (qEnvironmentVariableIsSet("SELACTION_WLPASTE_MODE")) {
+        const QString mode = qEnvironmentVariable("SELACTION_WLPASTE_MODE", effective.wlPasteMode);
+        if (!mode.isEmpty()) {
+            effective.wlPasteMode = mode;
+        }
+    }
+    if (qEnvironmentVariableIsSet("SELACTION_HISTORY_BYTES")) {
+        bool ok = false;
+        const int value = qEnvironmentVariableIntValue("SELACTION_HISTORY_BYTES", &ok);
+        if (ok && value >= 0) {
+            effective.historyBytes = value;
+        }
+    }
+    return effective;
+}
+
+// Strict UTF-8 check (no overlongs, surrogates or code points past U+10FFFF).
+// ASCII runs are skipped 16 bytes at a time with SSE2 where available.
+bool isValidUtf8(QByteArrayView bytes) {
+    const auto *data = reinterpret_cast<const uchar *>(bytes.data());
+    const qsizetype size = bytes.size();
+    qsizetype i = 0;
+    while (i < size) {
+#if defined(__SSE2__)
+        while (i + 16 <= size
+               && _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i))) == 0) {
+            i += 16;
+        }
+        if (i >= size) {
+            break;
+        }
+#endif
+        const uchar lead = data[i];
+        if (lead < 0x80) {
+            ++i;
+            continue;
+        }
+        qsizetype length = 0;
+        uchar minSecond = 0x80;
+        uchar maxSecond = 0xBF;
+        if (lead >= 0xC2 && lead <= 0xDF) {
+            length = 2;
+        } else if (lead >= 0xE0 && lead <= 0xEF) {
+            length = 3;
+            if (lead == 0xE0) {
+                minSecond = 0xA0;
+            } else if (lead == 0xED) {
+                maxSecond = 0x9F;
+            }
+        } else if (lead >= 0xF0 && lead <= 0xF4) {
+            length = 4;
+            if (lead == 0xF0) {
+                minSecond = 0x90;
+            } else if (lead == 0xF4) {
+                maxSecond = 0x8F;
+            }
+        } else {
+            return false;
+        }
+        if (i + length > size || data[i + 1] < minSecond || data[i + 1] > maxSecond) {
+            return false;
+        }
+        for (qsizetype k = 2; k < length; ++k) {
+            if ((data[i + k] & 0xC0) != 0x80) {
+                return false;
+            }
+        }
+        i += length;
+    }
+    return true;
+}
+
+// The code point of valid UTF-8 starting at pos, and its length in bytes.
+char32_t utf8CodePointAt(const QByteArray &utf8, qsizetype pos, qsizetype *length) {
+    const uchar lead = uchar(utf8[pos]);
+    qsizetype count = 1;
+    char32_t codePoint = lead;
+    if (lead >= 0xF0) {
+        count = 4;
+        codePoint = lead & 0x07;
+    } else if (lead >= 0xE0) {
+        count = 3;
+        codePoint = lead & 0x0F;
+    } else if (lead >= 0xC0) {
+        count = 2;
+        codePoint = lead & 0x1F;
+    }
+    for (qsizetype k = 1; k < count; ++k) {
+        codePoint = (codePoint << 6) | (uchar(utf8[pos + k]) & 0x3F);
+    }
+    *length = count;
+    return codePoint;
+}
+
+// Clipboard text is trimmed the same way whichever path read it, so both give
+// one fingerprint: leading and trailing code points for which QChar::isSpace()
+// holds (including U+00A0 and U+3000) are removed, as QString::trimmed() does.
+QString trimClipboardText(const QString &text) {
+    return text.trimmed();
+}
+
+// The same for valid UTF-8; QByteArray::trimmed() would only strip ASCII.
+QByteArray trimClipboardText(const QByteArray &utf8) {
+    qsizetype begin = 0;
+    qsizetype end = utf8.size();
+    qsizetype length = 0;
+    while (begin < end && QChar::isSpace(utf8CodePointAt(utf8, begin, &length))) {
+        begin += length;
+    }
+    while (end > begin) {
+        qsizetype start = end - 1;
+        while (start > begin && (uchar(utf8[start]) & 0xC0) == 0x80) {
+            --start;
+        }
+        if (!QChar::isSpace(utf8CodePointAt(utf8, start, &length))) {
+            break;
+        }
+        end = start;
+    }
+    return begin == 0 && end == utf8.size() ? utf8 : utf8.sliced(begin, end - begin);
+}
+
+// Raw wl-paste output, trimmed but not decoded. Payloads that are not valid
+// UTF-8 (e.g. an image on the clipboard) count as a failed read.
+QByteArray readWlPaste(const QStringList &args, int timeoutMs, bool *ok) {
     QProcess proc;
     proc.start("wl-paste", args);
     if (!proc.waitForFinished(timeoutMs)) {
@@ -204,34 +1046,251 @@ QString readWlPaste(const QStringList &args, int timeoutMs, bool *ok) {
         if (ok) {
             *ok = false;
         }
-        return QString();
+        return QByteArray();
     }
 
+    const QByteArray output = proc.readAllStandardOutput();
+    const bool valid = isValidUtf8(output);
     if (ok) {
-        *ok = (proc.exitStatus() == QProcess::NormalExit && proc.exitCode() == 0);
+        *ok = (proc.exitStatus() == QProcess::NormalExit && proc.exitCode() == 0 && valid);
     }
-    return QString::fromUtf8(proc.readAllStandardOutput()).trimmed();
+    return valid ? trimClipboardText(output) : QByteArray();
 }
 
-int logLevelFromString(const QString &level) {
-    const QString normalized = level.trimmed().toLower();
-    if (normalized == "debug") {
-        return 0;
-    }
-    if (normalized == "warning" || normalized == "warn") {
-        return 2;
-    }
-    if (normalized == "critical" || normalized == "error") {
-        return 3;
+// Fire-and-forget coroutine: it runs immediately up to its first suspension
+// and frees its frame when it finishes. The awaiters below resume it through a
+// context QObject; if the context is destroyed first the frame is never
+// resumed, so only start these on objects that live until shutdown.
+struct AsyncTask {
+    struct promise_type {
+        AsyncTask get_return_object() noexcept {
+            return {};
+        }
+        std::suspend_never initial_suspend() noexcept {
+            return {};
+        }
+        std::suspend_never final_suspend() noexcept {
+            return {};
+        }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept {
+            std::terminate();
+        }
+    };
+};
+
+// co_await delay(context, ms): resumes on the context's thread after ms.
+struct DelayAwaiter {
+    QObject *context = nullptr;
+    int ms = 0;
+
+    bool await_ready() const noexcept {
+        return false;
     }
-    if (normalized == "fatal") {
-        return 4;
+    void await_suspend(std::coroutine_handle<> handle) const {
+        QTimer::singleShot(ms, context, [handle]() { handle.resume(); });
     }
-    return 1;
+    void await_resume() const noexcept {}
+};
+
+DelayAwaiter delay(QObject *context, int ms) {
+    return {context, ms};
 }
 
-int gMinLogLevel = 1;
-QtMessageHandler gPrevLogHandler = nullptr;
+struct ProcessResult {
+    // Started and exited with status 0 before the timeout.
+    bool ok = false;
+    QByteArray output;
+};
+
+// co_await runProcess(context, program, args, timeoutMs): runs the process
+// without blocking the event loop and resumes with its stdout. A process that
+// outlives the timeout is killed and reported as failed.
+class ProcessAwaiter {
+public:
+    ProcessAwaiter(QObject *context, QString program, QStringList args, int timeoutMs)
+        : context_(context), program_(std::move(program)), args_(std::move(args)), timeoutMs_(timeoutMs) {}
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        auto *proc = new QProcess(context_);
+        const auto finish = [this, proc, handle](bool ok) {
+            proc->disconnect();
+            result_.ok = ok;
+            result_.output = proc->readAllStandardOutput();
+            proc->deleteLater();
+            handle.resume();
+        };
+        QObject::connect(proc, &QProcess::finished, proc, [finish](int exitCode, QProcess::ExitStatus status) {
+            finish(status == QProcess::NormalExit && exitCode == 0);
+        });
+        QObject::connect(proc, &QProcess::errorOccurred, proc, [finish](QProcess::ProcessError error) {
+            if (error == QProcess::FailedToStart) {
+                finish(false);
+            }
+        });
+        QTimer::singleShot(timeoutMs_, proc, [proc]() { proc->kill(); });
+        proc->start(program_, args_);
+    }
+
+    ProcessResult await_resume() {
+        return std::move(result_);
+    }
+
+private:
+    QObject *context_ = nullptr;
+    QString program_;
+    QStringList args_;
+    int timeoutMs_ = 0;
+    ProcessResult result_;
+};
+
+ProcessAwaiter runProcess(QObject *context, const QString &program, const QStringList &args, int timeoutMs) {
+    return ProcessAwaiter(context, program, args, timeoutMs);
+}
+
+// Bounded single-producer/single-consumer ring: push() is called from one
+// thread and pop() from another, and neither blocks or takes a lock.
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    bool push(T value) {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == Capacity) {
+            return false;
+        }
+        slots_[tail & (Capacity - 1)] = std::move(value);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &value) {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        T &slot = slots_[head & (Capacity - 1)];
+        value = std::move(slot);
+        slot = T();
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::array<T, Capacity> slots_;
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+};
+
+struct SourceEvent {
+    QClipboard::Mode mode = QClipboard::Clipboard;
+    // Null when wl-paste failed or was empty; the consumer falls back to Qt.
+    SharedText text;
+};
+
+// Samples wl-paste on the I/O thread so a slow compositor never stalls the
+// GUI. Changed or failed samples are queued with their fingerprint and UTF-16
+// view already computed, and the consumer is woken once per batch.
+class WlPasteReader : public QObject {
+    Q_OBJECT
+
+public:
+    WlPasteReader(std::function<void()> wake, bool trace)
+        : wake_(std::move(wake)), trace_(trace), timer_(new QTimer(this)) {
+        connect(timer_, &QTimer::timeout, this, &WlPasteReader::sample);
+    }
+
+    // Called on the I/O thread. Forgets what was seen, so the next sample of
+    // every mode is delivered again.
+    void start(const QList<QClipboard::Mode> &modes, int intervalMs) {
+        modes_ = modes;
+        lastFingerprints_ = {};
+        timer_->start(intervalMs);
+        sample();
+    }
+
+    void stop() {
+        timer_->stop();
+    }
+
+    // Consumer side: clear the wake flag first, then pop until empty; anything
+    // pushed after the flag was cleared triggers another wake-up.
+    void beginDrain() {
+        wakePending_.store(false, std::memory_order_release);
+    }
+
+    bool next(SourceEvent &event) {
+        return queue_.pop(event);
+    }
+
+private:
+    void sample() {
+        bool queued = false;
+        for (const QClipboard::Mode mode : modes_) {
+            const QStringList args = mode == QClipboard::Clipboard ? QStringList() : QStringList{"--primary"};
+            bool ok = false;
+            const QByteArray utf8 = readWlPaste(args, 200, &ok);
+            if (trace_) {
+                qInfo() << "Trace: wl-paste" << args << "ok=" << ok << "bytes=" << utf8.size();
+            }
+            std::optional<quint64> &last = lastFingerprints_[mode == QClipboard::Selection ? 1 : 0];
+            SourceEvent event{mode, SharedText()};
+            std::optional<quint64> fingerprint;
+            if (ok && !utf8.isEmpty()) {
+                event.text = SharedText::fromUtf8(utf8);
+                fingerprint = event.text.fingerprint();
+                if (last == fingerprint) {
+                    continue;
+                }
+                event.text.text();
+            }
+            if (!queue_.push(std::move(event))) {
+                qWarning() << "Source queue full; dropping a sample.";
+                continue;
+            }
+            // Only a delivered sample counts as seen, so a dropped one is
+            // offered again on the next tick.
+            last = fingerprint;
+            queued = true;
+        }
+        if (queued && !wakePending_.exchange(true, std::memory_order_acq_rel)) {
+            wake_();
+        }
+    }
+
+    std::function<void()> wake_;
+    bool trace_ = false;
+    QTimer *timer_ = nullptr;
+    QList<QClipboard::Mode> modes_;
+    std::array<std::optional<quint64>, 2> lastFingerprints_;
+    SpscQueue<SourceEvent, 64> queue_;
+    std::atomic<bool> wakePending_{false};
+};
+
+int logLevelFromString(const QString &level) {
+    const QString normalized = level.trimmed().toLower();
+    if (normalized == "debug") {
+        return 0;
+    }
+    if (normalized == "warning" || normalized == "warn") {
+        return 2;
+    }
+    if (normalized == "critical" || normalized == "error") {
+        return 3;
+    }
+    if (normalized == "fatal") {
+        return 4;
+    }
+    return 1;
+}
+
+int gMinLogLevel = 1;
+QtMessageHandler gPrevLogHandler = nullptr;
 
 int logSeverity(QtMsgType type) {
     switch (type) {
@@ -261,80 +1320,695 @@ void logHandler(QtMsgType type, const QMessageLogContext &context, const QString
     std::fprintf(stderr, "%s\n", bytes.constData());
 }
 
-class PopupController : public QObject {
+QByteArray transformLines(const QByteArray &block, selaction::text::Transform transform) {
+    QByteArray out;
+    out.reserve(block.size() + block.size() / 8);
+    QString line;
+    QString transformed;
+    qsizetype start = 0;
+    while (start < block.size()) {
+        qsizetype end = block.indexOf('\n', start);
+        const bool hasNewline = end >= 0;
+        if (!hasNewline) {
+            end = block.size();
+        }
+        line = QString::fromUtf8(block.constData() + start, end - start);
+        transform(line, transformed);
+        out.append(transformed.toUtf8());
+        if (hasNewline) {
+            out.append('\n');
+        }
+        start = end + 1;
+    }
+    return out;
+}
+
+// Where to split a line longer than a block: after a space in its second half,
+// or else before its last code point, which may still be incomplete.
+qsizetype lineSplitPoint(const QByteArray &line) {
+    const qsizetype space = line.lastIndexOf(' ');
+    if (space >= line.size() / 2) {
+        return space + 1;
+    }
+    qsizetype start = line.size() - 1;
+    while (start > 0 && line.size() - start < 4 && (uchar(line[start]) & 0xC0) == 0x80) {
+        --start;
+    }
+    return start;
+}
+
+// Headless pipeline mode: transforms stdin to stdout line by line. Input is read
+// in blocks cut at line ends, and a line longer than a block is split at a
+// space or code point boundary; with jobs > 1 up to that many blocks are
+// transformed concurrently and written back in order, so memory stays bounded
+// by about jobs * block size.
+int runBatch(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Apply a selaction transform to stdin.");
+    parser.addHelpOption();
+    parser.addOption({"batch", "Run headless, reading stdin and writing stdout."});
+    parser.addOption({"action", "Transform: upper, lower, title, normalize, copy.", "name"});
+    parser.addOption({"jobs", "Blocks transformed in parallel (default: CPU count).", "count"});
+    parser.process(app);
+
+    const selaction::text::Transform transform = selaction::text::transformByName(parser.value("action"));
+    if (!transform) {
+        std::fprintf(stderr, "Unknown or missing --action (upper, lower, title, normalize, copy).\n");
+        return 2;
+    }
+    int jobs = QThread::idealThreadCount();
+    if (parser.isSet("jobs")) {
+        jobs = parser.value("jobs").toInt();
+    }
+    jobs = qMax(1, jobs);
+
+    QFile input;
+    QFile output;
+    if (!input.open(stdin, QIODevice::ReadOnly) || !output.open(stdout, QIODevice::WriteOnly)) {
+        std::fprintf(stderr, "Cannot open stdin/stdout.\n");
+        return 1;
+    }
+
+    constexpr qint64 kBlockBytes = 1024 * 1024;
+    QQueue<QFuture<QByteArray>> inFlight;
+    bool writeFailed = false;
+    const auto writeOldest = [&]() {
+        const QByteArray result = inFlight.dequeue().result();
+        if (output.write(result) != result.size()) {
+            writeFailed = true;
+        }
+    };
+    const auto submit = [&](const QByteArray &block) {
+        if (jobs == 1) {
+            const QByteArray result = transformLines(block, transform);
+            if (output.write(result) != result.size()) {
+                writeFailed = true;
+            }
+            return;
+        }
+        if (inFlight.size() >= jobs) {
+            writeOldest();
+        }
+        inFlight.enqueue(QtConcurrent::run(transformLines, block, transform));
+    };
+
+    QByteArray pending;
+    while (!writeFailed) {
+        const QByteArray data = input.read(kBlockBytes);
+        if (data.isEmpty()) {
+            break;
+        }
+        pending.append(data);
+        qsizetype cut = pending.lastIndexOf('\n') + 1;
+        if (cut == 0 && pending.size() >= kBlockBytes) {
+            cut = lineSplitPoint(pending);
+        }
+        if (cut <= 0) {
+            continue;
+        }
+        submit(pending.left(cut));
+        pending.remove(0, cut);
+    }
+    if (!pending.isEmpty() && !writeFailed) {
+        submit(pending);
+    }
+    while (!inFlight.isEmpty()) {
+        writeOldest();
+    }
+    if (!output.flush()) {
+        writeFailed = true;
+    }
+    if (writeFailed) {
+        std::fprintf(stderr, "Write to stdout failed.\n");
+        return 1;
+    }
+    return 0;
+}
+
+// Resident set size of this process, or -1 where /proc is unavailable.
+qint64 residentBytes() {
+    QFile file("/proc/self/statm");
+    if (!file.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+    const QList<QByteArray> fields = file.readAll().split(' ');
+    bool ok = false;
+    const qint64 pages = fields.value(1).toLongLong(&ok);
+    return ok ? pages * sysconf(_SC_PAGESIZE) : -1;
+}
+
+// Returns freed heap pages to the OS; glibc keeps them otherwise.
+void releaseFreeHeap() {
+#if defined(__GLIBC__)
+    malloc_trim(0);
+#endif
+}
+
+// Per-phase startup timings. Always measures time-to-ready; the breakdown is
+// printed when SELACTION_PROFILE_STARTUP is set or --profile-startup is passed.
+struct StartupProfile {
+    bool verbose = false;
+    QElapsedTimer timer;
+    qint64 lastNs = 0;
+    QList<QPair<QByteArray, qint64>> phases;
+
+    void start() {
+        timer.start();
+    }
+
+    void mark(const char *phase) {
+        const qint64 now = timer.nsecsElapsed();
+        phases.append({QByteArray(phase), now - lastNs});
+        lastNs = now;
+    }
+
+    void report() const {
+        if (verbose) {
+            for (const auto &phase : phases) {
+                std::fprintf(stderr, "startup %-16s %8.2f ms\n", phase.first.constData(), phase.second / 1e6);
+            }
+            std::fprintf(stderr, "startup %-16s %8.2f ms\n", "total", lastNs / 1e6);
+        }
+        qInfo() << "selaction ready in" << lastNs / 1000000 << "ms";
+    }
+};
+
+StartupProfile gStartupProfile;
+
+QString commandSocketPath() {
+    const QString runtimeDir = QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation);
+    if (runtimeDir.isEmpty()) {
+        // The temp directory is shared between users; keep their daemons apart.
+        return QDir::tempPath() + QString("/selaction-%1.sock").arg(getuid());
+    }
+    return runtimeDir + "/selaction.sock";
+}
+
+bool daemonAnswers(const QString &socketPath) {
+    QLocalSocket socket;
+    socket.connectToServer(socketPath);
+    return socket.waitForConnected(300);
+}
+
+// Local-socket command API of the running daemon. A client sends one JSON array
+// of strings terminated by a newline and gets a JSON object
+// {"ok": bool, "output": string} back before the server closes the connection.
+class CommandServer : public QObject {
     Q_OBJECT
 
 public:
-    explicit PopupController(const AppSettings &settings, QObject *parent = nullptr)
+    using Handler = std::function<QJsonObject(const QStringList &)>;
+
+    explicit CommandServer(QObject *parent = nullptr)
         : QObject(parent) {
-        clipboard_ = QGuiApplication::clipboard();
-        qInfo() << "Clipboard available:" << (clipboard_ != nullptr);
-        qInfo() << "Supports selection:" << clipboard_->supportsSelection();
-        qInfo() << "Supports find buffer:" << clipboard_->supportsFindBuffer();
-        connect(clipboard_, &QClipboard::dataChanged, this, &PopupController::onClipboardChanged);
-        connect(clipboard_, &QClipboard::selectionChanged, this, &PopupController::onSelectionChanged);
+        connect(&server_, &QLocalServer::newConnection, this, &CommandServer::acceptConnections);
+    }
+
+    void setHandler(Handler handler) {
+        handler_ = std::move(handler);
+    }
+
+    bool listen(const QString &path) {
+        server_.setSocketOptions(QLocalServer::UserAccessOption);
+        if (server_.listen(path)) {
+            return true;
+        }
+        // A previous daemon may have died without removing its socket. Only a
+        // socket nobody answers on is removed; a live one belongs to another
+        // instance.
+        if (daemonAnswers(path)) {
+            qWarning() << "Command socket is owned by another selaction instance:" << path;
+            return false;
+        }
+        QLocalServer::removeServer(path);
+        if (!server_.listen(path)) {
+            qWarning() << "Command socket unavailable:" << server_.errorString();
+            return false;
+        }
+        return true;
+    }
+
+private:
+    void acceptConnections() {
+        while (QLocalSocket *socket = server_.nextPendingConnection()) {
+            connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+            connect(socket, &QLocalSocket::readyRead, this, [this, socket]() {
+                if (!socket->canReadLine()) {
+                    if (socket->bytesAvailable() > kMaxRequestBytes) {
+                        socket->abort();
+                    }
+                    return;
+                }
+                const QJsonDocument request = QJsonDocument::fromJson(socket->readLine());
+                QStringList command;
+                for (const QJsonValue &value : request.array()) {
+                    command.append(value.toString());
+                }
+                QJsonObject reply;
+                if (command.isEmpty()) {
+                    reply.insert("ok", false);
+                    reply.insert("output", "Malformed command.");
+                } else if (handler_) {
+                    reply = handler_(command);
+                }
+                socket->write(QJsonDocument(reply).toJson(QJsonDocument::Compact));
+                socket->write("\n");
+                socket->disconnectFromServer();
+            });
+        }
+    }
+
+    static constexpr qint64 kMaxRequestBytes = 64 * 1024;
+
+    QLocalServer server_;
+    Handler handler_;
+};
+
+// Forwards a command to a running daemon. Runs before any application object
+// exists so a second invocation stays a thin client. Returns false when no
+// daemon answers on the socket.
+bool sendCommand(const QString &socketPath, const QStringList &command, int *exitCode) {
+    QLocalSocket socket;
+    socket.connectToServer(socketPath);
+    if (!socket.waitForConnected(300)) {
+        return false;
+    }
+
+    QByteArray request = QJsonDocument(QJsonArray::fromStringList(command)).toJson(QJsonDocument::Compact);
+    request.append('\n');
+    socket.write(request);
+    socket.waitForBytesWritten(1000);
+
+    QByteArray response;
+    while (!response.contains('\n') && socket.waitForReadyRead(5000)) {
+        response += socket.readAll();
+    }
+    response += socket.readAll();
+
+    const QJsonObject reply = QJsonDocument::fromJson(response).object();
+    const QByteArray output = reply.value("output").toString().toLocal8Bit();
+    const bool ok = reply.value("ok").toBool(false);
+    std::fprintf(ok ? stdout : stderr, "%s\n", output.constData());
+    *exitCode = ok ? 0 : 1;
+    return true;
+}
+
+QString resolveIconPath(const QString &spec) {
+    if (spec.startsWith("file:")) {
+        const QString localPath = QUrl(spec).toLocalFile();
+        if (QFileInfo::exists(localPath)) {
+            return localPath;
+        }
+        return QString();
+    }
+    QString path = spec;
+    if (spec.startsWith("~")) {
+        path = QDir::homePath() + spec.mid(1);
+    }
+    if (QDir::isAbsolutePath(path) && QFileInfo::exists(path)) {
+        return path;
+    }
+    return QString();
+}
+
+// Local icon files (.ico, .png, .svg, ...) decoded in-process. For every device
+// pixel ratio among the connected screens the best sub-image is scaled once and
+// stored as PNG under ~/.cache/selaction/icons; cache file names carry the
+// source mtime and size, so an edited source simply misses the cache.
+//
+// prefetch() decodes on the thread pool and turns the images into pixmaps on
+// the GUI thread a few icons per event-loop pass, so building the popup only
+// hits the in-memory map. icon() never decodes itself; a miss queues the file
+// and iconsReady() tells the popup to pick it up.
+class FileIconCache : public QObject {
+    Q_OBJECT
 
-        debounce_.setSingleShot(true);
-        debounce_.setInterval(120);
-        connect(&debounce_, &QTimer::timeout, this, &PopupController::showMenuIfNeeded);
+public:
+    explicit FileIconCache(QObject *parent = nullptr)
+        : QObject(parent) {
+        slicer_.setInterval(0);
+        connect(&slicer_, &QTimer::timeout, this, &FileIconCache::convertSlice);
+    }
 
-        AppSettings effective = settings;
-        if (qEnvironmentVariableIsSet("SELACTION_POLL")) {
-            effective.pollEnabled = true;
+    // A null icon while path is still decoding or could not be decoded, so the
+    // caller shows its fallback until iconsReady() is emitted.
+    QIcon icon(const QString &path, int logicalSize) {
+        const QString key = cacheKey(path, logicalSize);
+        const auto found = icons_.constFind(key);
+        if (found != icons_.constEnd()) {
+            return found.value();
         }
-        if (qEnvironmentVariableIsSet("SELACTION_POLL_MS")) {
-            const int value = qEnvironmentVariableIntValue("SELACTION_POLL_MS");
-            if (value > 0) {
-                effective.pollIntervalMs = value;
+        prefetch({path}, logicalSize);
+        return QIcon();
+    }
+
+    void prefetch(const QStringList &paths, int logicalSize) {
+        QList<DecodeJob> jobs;
+        const QList<int> sizes = pixelSizes(logicalSize);
+        for (const QString &path : paths) {
+            const QString key = cacheKey(path, logicalSize);
+            if (icons_.contains(key) || pending_.contains(key)) {
+                continue;
             }
+            pending_.insert(key);
+            jobs.append({path, key, sizes});
         }
-        if (qEnvironmentVariableIsSet("SELACTION_WLPASTE")) {
-            effective.wlPasteEnabled = true;
+        if (jobs.isEmpty()) {
+            return;
         }
-        if (qEnvironmentVariableIsSet("SELACTION_WLPASTE_MODE")) {
-            const QString mode = qEnvironmentVariable("SELACTION_WLPASTE_MODE", effective.wlPasteMode);
-            if (!mode.isEmpty()) {
-                effective.wlPasteMode = mode;
+        qDebug() << "Decoding" << jobs.size() << "icons in the background.";
+        auto *watcher = new QFutureWatcher<DecodedIcon>(this);
+        connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher]() {
+            for (const DecodedIcon &decoded : watcher->future().results()) {
+                ready_.enqueue(decoded);
             }
+            watcher->deleteLater();
+            slicer_.start();
+        });
+        watcher->setFuture(QtConcurrent::mapped(jobs, &FileIconCache::decodeJob));
+    }
+
+signals:
+    void iconsReady();
+
+public:
+    void clear() {
+        icons_.clear();
+        icons_.squeeze();
+    }
+
+    // Picks the smallest sub-image that is at least pixelSize (or the largest
+    // one) and scales it to pixelSize x pixelSize.
+    static QImage decode(const QString &path, int pixelSize) {
+        QImageReader reader(path);
+        if (reader.supportsOption(QImageIOHandler::ScaledSize) && reader.format() == "svg") {
+            reader.setScaledSize(QSize(pixelSize, pixelSize));
+            return reader.read();
         }
 
-        pollEnabled_ = effective.pollEnabled;
-        pollIntervalMs_ = effective.pollIntervalMs;
-        wlPasteEnabled_ = effective.wlPasteEnabled;
-        wlPasteMode_ = effective.wlPasteMode;
-        popup_.setActionIconsPerRow(effective.actionIconsPerRow);
-        traceEnabled_ = qEnvironmentVariableIsSet("SELACTION_TRACE");
-        if (pollEnabled_) {
-            pollTimer_.setInterval(pollIntervalMs_);
-            connect(&pollTimer_, &QTimer::timeout, this, &PopupController::pollClipboard);
-            qInfo() << "Polling enabled" << "interval_ms=" << pollIntervalMs_;
+        int best = 0;
+        int bestEdge = -1;
+        const int count = qMax(1, reader.imageCount());
+        for (int i = 0; i < count; ++i) {
+            if (count > 1 && !reader.jumpToImage(i)) {
+                break;
+            }
+            const QSize size = reader.size();
+            const int edge = qMax(size.width(), size.height());
+            const bool bigEnough = edge >= pixelSize;
+            const bool bestBigEnough = bestEdge >= pixelSize;
+            if (bestEdge < 0 || (bigEnough && (!bestBigEnough || edge < bestEdge))
+                || (!bigEnough && !bestBigEnough && edge > bestEdge)) {
+                best = i;
+                bestEdge = edge;
+            }
+        }
+        if (count > 1) {
+            reader.jumpToImage(best);
         }
+        const QImage image = reader.read();
+        if (image.isNull()) {
+            return image;
+        }
+        return image.scaled(pixelSize, pixelSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
 
-        popup_.setOnClosed([this]() {
-            popupVisible_ = false;
-            nextAllowedPopupMs_ = popupTimer_.elapsed() + 800;
-            if (pollEnabled_) {
-                QTimer::singleShot(300, this, [this]() {
-                    if (pollEnabled_ && !popupVisible_) {
-                        pollTimer_.start();
-                    }
-                });
+private:
+    struct DecodeJob {
+        QString path;
+        QString key;
+        QList<int> pixelSizes;
+    };
+
+    struct DecodedIcon {
+        QString path;
+        QString key;
+        QList<QImage> images;
+    };
+
+    static constexpr int kIconsPerSlice = 4;
+
+    static DecodedIcon decodeJob(const DecodeJob &job) {
+        DecodedIcon decoded;
+        decoded.path = job.path;
+        decoded.key = job.key;
+        bool saved = false;
+        for (const int pixelSize : job.pixelSizes) {
+            const QString cached = cacheFile(job.key, pixelSize);
+            QImage image(cached);
+            if (image.isNull()) {
+                image = decode(job.path, pixelSize);
+                if (!image.isNull()) {
+                    saved = saveCached(image, cached) || saved;
+                }
+            }
+            if (!image.isNull()) {
+                decoded.images.append(image);
+            }
+        }
+        if (saved) {
+            pruneStale(job.key, job.pixelSizes);
+        }
+        return decoded;
+    }
+
+    void convertSlice() {
+        for (int i = 0; i < kIconsPerSlice && !ready_.isEmpty(); ++i) {
+            const DecodedIcon decoded = ready_.dequeue();
+            pending_.remove(decoded.key);
+            QIcon icon;
+            for (const QImage &image : decoded.images) {
+                icon.addPixmap(QPixmap::fromImage(image));
+            }
+            if (icon.isNull()) {
+                qWarning() << "Cannot decode icon" << decoded.path;
+            }
+            // Failures are remembered too, so they are not retried on every popup.
+            icons_.insert(decoded.key, icon);
+        }
+        if (ready_.isEmpty()) {
+            slicer_.stop();
+        }
+        emit iconsReady();
+    }
+
+    static QString cacheKey(const QString &path, int logicalSize) {
+        const QFileInfo source(path);
+        return QString("%1-%2-%3-%4")
+            .arg(textFingerprint(source.absoluteFilePath().toUtf8()), 16, 16, QChar('0'))
+            .arg(source.lastModified().toMSecsSinceEpoch())
+            .arg(source.size())
+            .arg(logicalSize);
+    }
+
+    static QString cacheDir() {
+        return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + "/selaction/icons";
+    }
+
+    static QString cacheFile(const QString &key, int pixelSize) {
+        return cacheDir() + "/" + key + QString("-%1px.png").arg(pixelSize);
+    }
+
+    // Drops cache files of the same source that no longer match it: other
+    // mtime/size stamps, and pixel sizes of this key no screen uses any more.
+    // Other logical sizes of the current source are left alone.
+    static void pruneStale(const QString &key, const QList<int> &pixelSizes) {
+        const QString pathPrefix = key.left(key.indexOf('-') + 1);
+        const QString stampPrefix = key.left(key.lastIndexOf('-') + 1);
+        const QString keyPrefix = key + "-";
+        QDir dir(cacheDir());
+        for (const QString &name : dir.entryList({pathPrefix + "*px.png"}, QDir::Files)) {
+            bool stale = !name.startsWith(stampPrefix);
+            if (!stale && name.startsWith(keyPrefix)) {
+                const int pixelSize = QStringView(name).sliced(keyPrefix.size()).chopped(6).toInt();
+                stale = !pixelSizes.contains(pixelSize);
+            }
+            if (stale) {
+                dir.remove(name);
+            }
+        }
+    }
+
+    // Written through QSaveFile so a concurrent reader never sees a partial PNG.
+    static bool saveCached(const QImage &image, const QString &path) {
+        QDir().mkpath(cacheDir());
+        QSaveFile file(path);
+        if (!file.open(QIODevice::WriteOnly) || !image.save(&file, "PNG")) {
+            return false;
+        }
+        return file.commit();
+    }
+
+    static QList<int> pixelSizes(int logicalSize) {
+        QList<int> sizes;
+        for (const QScreen *screen : QGuiApplication::screens()) {
+            const int size = qRound(logicalSize * screen->devicePixelRatio());
+            if (!sizes.contains(size)) {
+                sizes.append(size);
             }
+        }
+        if (sizes.isEmpty()) {
+            sizes.append(logicalSize);
+        }
+        return sizes;
+    }
+
+    QHash<QString, QIcon> icons_;
+    QSet<QString> pending_;
+    QQueue<DecodedIcon> ready_;
+    QTimer slicer_;
+};
+
+class PopupController : public QObject {
+    Q_OBJECT
+
+public:
+    explicit PopupController(const AppSettings &settings, QObject *parent = nullptr)
+        : QObject(parent) {
+        clipboard_ = QGuiApplication::clipboard();
+        qInfo() << "Clipboard available:" << (clipboard_ != nullptr);
+        qInfo() << "Supports selection:" << clipboard_->supportsSelection();
+        qInfo() << "Supports find buffer:" << clipboard_->supportsFindBuffer();
+        connect(clipboard_, &QClipboard::dataChanged, this, &PopupController::onClipboardChanged);
+        connect(clipboard_, &QClipboard::selectionChanged, this, &PopupController::onSelectionChanged);
+
+        history_.setOnAdded([this](quint64 fingerprint, QByteArrayView utf8) {
+            historySearch_.add(fingerprint, utf8);
+        });
+        history_.setOnRemoved([this](quint64 fingerprint) {
+            historySearch_.remove(fingerprint);
+        });
+        traceEnabled_ = qEnvironmentVariableIsSet("SELACTION_TRACE");
+        connect(&pollTimer_, &QTimer::timeout, this, &PopupController::pollClipboard);
+        sourceReader_ = new WlPasteReader([this]() {
+            QMetaObject::invokeMethod(this, [this]() { drainSourceEvents(); }, Qt::QueuedConnection);
+        }, traceEnabled_);
+        sourceReader_->moveToThread(&ioThread_);
+        ioThread_.setObjectName("selaction-io");
+        idleTimer_.setSingleShot(true);
+        connect(&idleTimer_, &QTimer::timeout, this, &PopupController::compactWhenIdle);
+        baselineSave_.setSingleShot(true);
+        baselineSave_.setInterval(kBaselineSaveDelayMs);
+        connect(&baselineSave_, &QTimer::timeout, this, &PopupController::saveBaseline);
+        fallbackEnd_.setSingleShot(true);
+        connect(&fallbackEnd_, &QTimer::timeout, this, [this]() {
+            restartPolling();
+            scheduleFallbackEnd();
         });
+        connect(qApp, &QCoreApplication::aboutToQuit, this, &PopupController::saveBaseline);
+        connect(qApp, &QCoreApplication::aboutToQuit, &historyLog_, &HistoryLog::flush);
         popupTimer_.start();
-        if (wlPasteEnabled_) {
-            qInfo() << "wl-paste fallback enabled";
-            qInfo() << "wl-paste mode:" << wlPasteMode_;
+
+        applySettings(withEnvironmentOverrides(settings));
+        gStartupProfile.mark("apply_settings");
+        watchConfig();
+
+        // The popup and action config are built on first use, or once the
+        // session had time to settle, whichever comes first.
+        QTimer::singleShot(kWarmUpDelayMs, this, [this]() {
+            popup();
+            externalActions();
+            qDebug() << "Warm-up done.";
+        });
+    }
+
+    ~PopupController() override {
+        // The reader and its timer belong to the I/O thread, so they are deleted
+        // there: the deferred delete runs as the thread finishes.
+        if (ioThread_.isRunning()) {
+            sourceReader_->deleteLater();
+            ioThread_.quit();
+            ioThread_.wait();
+        } else {
+            delete sourceReader_;
         }
+    }
 
-        // Delay first poll to avoid immediate popup on app start.
-        if (pollEnabled_) {
-            QTimer::singleShot(pollIntervalMs_, this, [this]() {
-                if (pollEnabled_ && !popupVisible_) {
-                    pollTimer_.start();
+    QJsonObject handleCommand(const QStringList &command) {
+        noteActivity();
+        const QString name = command.value(0).toLower();
+        QJsonObject reply;
+        reply.insert("ok", true);
+
+        if (name == "ping") {
+            reply.insert("output", "selaction is running.");
+        } else if (name == "apply" && command.size() >= 2) {
+            const QString label = command.mid(1).join(' ');
+            SharedText text = lastText_;
+            if (text.isEmpty()) {
+                text = readQtClipboard(QClipboard::Clipboard);
+            }
+            if (text.isEmpty()) {
+                reply.insert("ok", false);
+                reply.insert("output", "No text to act on.");
+                return reply;
+            }
+            const QList<MenuAction> actions = actionsForText(text, true);
+            const MenuAction *match = nullptr;
+            for (const MenuAction &action : actions) {
+                if (action.label.compare(label, Qt::CaseInsensitive) == 0) {
+                    match = &action;
+                    break;
                 }
-            });
+                if (!match && action.label.startsWith(label, Qt::CaseInsensitive)) {
+                    match = &action;
+                }
+            }
+            if (!match || !match->handler) {
+                reply.insert("ok", false);
+                reply.insert("output", "Unknown action: " + label);
+                return reply;
+            }
+            qInfo() << "IPC apply:" << match->label;
+            match->handler();
+            reply.insert("output", "Applied " + match->label);
+        } else if (name == "reload") {
+            reloadSettings();
+            reply.insert("output", "Settings reloaded.");
+        } else if (name == "stats") {
+            const ClipboardHistory::Stats stats = history_.stats();
+            QStringList lines;
+            lines << QString("uptime_s %1").arg(popupTimer_.elapsed() / 1000)
+                  << QString("popups_shown %1").arg(popupsShown_)
+                  << QString("history_entries %1").arg(stats.entries)
+                  << QString("history_chunks %1").arg(stats.chunks)
+                  << QString("history_logical_bytes %1").arg(stats.logicalBytes)
+                  << QString("history_stored_bytes %1").arg(stats.storedBytes)
+                  << QString("history_overhead_bytes %1").arg(stats.overheadBytes)
+                  << QString("history_dedup_ratio %1").arg(stats.dedupRatio(), 0, 'f', 2)
+                  << QString("history_disk_bytes %1").arg(historyLog_.isOpen() ? historyLog_.diskBytes() : 0)
+                  << QString("rss_bytes %1").arg(residentBytes());
+            for (const QClipboard::Mode mode : {QClipboard::Clipboard, QClipboard::Selection}) {
+                const SourceReadStats &read = readStats_[statsIndex(mode)];
+                const QString source = mode == QClipboard::Selection ? "selection" : "clipboard";
+                lines << QString("%1_reads %2").arg(source).arg(read.reads)
+                      << QString("%1_read_stalls %2").arg(source).arg(read.stalls)
+                      << QString("%1_read_worst_ms %2").arg(source).arg(read.worstMs)
+                      << QString("%1_wlpaste_fallback %2").arg(source).arg(
+                             stallFallbackActive(mode) ? 1 : 0);
+            }
+            reply.insert("output", lines.join('\n'));
+        } else if (name == "history" && command.value(1) == "search" && command.size() >= 3) {
+            const QString query = command.mid(2).join(' ');
+            QElapsedTimer timer;
+            timer.start();
+            HistorySearchIndex::SearchStats searchStats;
+            const QList<HistorySearchIndex::Match> matches =
+                historySearch_.search(query, kHistorySearchResults, history_, &searchStats);
+            const qint64 searchUs = timer.nsecsElapsed() / 1000;
+            QStringList lines;
+            for (const HistorySearchIndex::Match &match : matches) {
+                lines << previewText(history_.text(match.fingerprint));
+            }
+            qInfo() << "IPC history search entries=" << historySearch_.size() << "candidates=" << searchStats.candidates
+                    << "fuzzy_scanned=" << searchStats.fuzzyScanned << "matches=" << matches.size() << "us=" << searchUs;
+            reply.insert("output", lines.join('\n'));
+        } else {
+            reply.insert("ok", false);
+            reply.insert("output", "Usage: selaction [ping | apply <action> | reload | stats | history search <query>]");
         }
+        return reply;
     }
 
 private slots:
@@ -345,8 +2019,7 @@ private slots:
             return;
         }
         qInfo() << "Clipboard changed.";
-        pendingMode_ = QClipboard::Clipboard;
-        debounce_.start();
+        ingest(QClipboard::Clipboard);
     }
 
     void onSelectionChanged() {
@@ -356,23 +2029,19 @@ private slots:
             return;
         }
         qInfo() << "Selection changed.";
-        pendingMode_ = QClipboard::Selection;
-        debounce_.start();
-    }
-
-    void showMenuIfNeeded() {
-        const QString text = clipboard_->text(pendingMode_).trimmed();
-        qInfo() << "Evaluating text from mode" << pendingMode_
-                << "len=" << text.size() << "preview=" << previewText(text);
-        showMenuIfNeededWithText(text);
+        ingest(QClipboard::Selection);
     }
 
-    void showMenuIfNeededWithText(const QString &text) {
+    void showMenuIfNeededWithText(const SharedText &text) {
         if (text.isEmpty()) {
             qInfo() << "No text to act on.";
             return;
         }
         lastText_ = text;
+        lastTextFingerprint_ = recordHistory(text);
+        qDebug() << "Selection bytes=" << text.utf8().size()
+                 << "ascii=" << text.has(SharedText::Ascii) << "multiline=" << text.has(SharedText::Multiline);
+        noteActivity();
         showMenu(text);
     }
 
@@ -395,21 +2064,67 @@ private:
             onClosed_ = std::move(handler);
         }
 
+        static constexpr int kDefaultIconSize = 20;
+
+        void setFileIconCache(FileIconCache *cache) {
+            fileIcons_ = cache;
+            connect(cache, &FileIconCache::iconsReady, this, [this]() {
+                if (isVisible()) {
+                    refreshActionIcons();
+                }
+            });
+        }
+
         void setActionIconsPerRow(int count) {
-            actionIconsPerRow_ = qMax(1, count);
+            const int clamped = qMax(1, count);
+            if (clamped == actionIconsPerRow_) {
+                return;
+            }
+            actionIconsPerRow_ = clamped;
+            if (isVisible()) {
+                rebuildGrid();
+            }
+        }
+
+        // Replaces label filtering for the current content: typed text is handed to
+        // the provider, which returns the actions to show.
+        void setFilterProvider(std::function<QList<MenuAction>(const QString &)> provider) {
+            filterProvider_ = std::move(provider);
         }
 
-        void setContent(const QString &selectedText, const QList<MenuAction> &actions) {
+        void setContent(const SharedText &selectedText, const QList<MenuAction> &actions) {
             Q_UNUSED(selectedText);
-            actions_ = actions;
-            visibleActions_.clear();
-            for (const MenuAction &action : actions_) {
+            filterProvider_ = nullptr;
+            actions_.clear();
+            labelIndex_.clear();
+            for (const MenuAction &action : actions) {
                 if (action.enabled) {
-                    visibleActions_.append(action);
+                    actions_.append(action);
+                    labelIndex_.append(action.label.toLower());
                 }
             }
-            currentPage_ = 0;
-            rebuildGrid();
+            filterText_.clear();
+            applyFilter(false);
+        }
+
+        // Drops the actions (and the texts their handlers captured) and the
+        // grid buttons while the popup is hidden.
+        void clearContent() {
+            filterProvider_ = nullptr;
+            actions_.clear();
+            actions_.squeeze();
+            visibleActions_.clear();
+            visibleActions_.squeeze();
+            labelIndex_.clear();
+            labelIndex_.squeeze();
+            filterMatches_.clear();
+            filterMatches_.squeeze();
+            filterText_.clear();
+            filterText_.squeeze();
+            while (QLayoutItem *item = grid_->takeAt(0)) {
+                delete item->widget();
+                delete item;
+            }
         }
 
         void showAtCursor() {
@@ -448,13 +2163,96 @@ private:
 
         void keyPressEvent(QKeyEvent *event) override {
             if (event->key() == Qt::Key_Escape) {
+                if (!filterText_.isEmpty()) {
+                    filterText_.clear();
+                    applyFilter(false);
+                    return;
+                }
                 hide();
                 return;
             }
+            if (event->key() == Qt::Key_Backspace) {
+                if (!filterText_.isEmpty()) {
+                    filterText_.chop(1);
+                    applyFilter(false);
+                }
+                return;
+            }
+            if (event->key() == Qt::Key_Return || event->key() == Qt::Key_Enter) {
+                triggerAction(currentPage_ * qMax(1, actionIconsPerRow_));
+                return;
+            }
+            const QString typed = event->text().toLower();
+            if (!typed.isEmpty() && typed.at(0).isPrint()
+                && !(event->modifiers() & (Qt::ControlModifier | Qt::AltModifier | Qt::MetaModifier))) {
+                filterText_ += typed;
+                applyFilter(true);
+                return;
+            }
             QWidget::keyPressEvent(event);
         }
 
     private:
+        // Narrowing only ever removes matches, so when the filter grew we re-check
+        // the previous result set instead of scanning every label again.
+        void applyFilter(bool narrowing) {
+            if (filterProvider_ && !filterText_.isEmpty()) {
+                visibleActions_ = filterProvider_(filterText_);
+                currentPage_ = 0;
+                rebuildGrid();
+                return;
+            }
+
+            QList<int> candidates;
+            if (narrowing) {
+                candidates = filterMatches_;
+            } else {
+                candidates.reserve(actions_.size());
+                for (int i = 0; i < actions_.size(); ++i) {
+                    candidates.append(i);
+                }
+            }
+
+            filterMatches_.clear();
+            if (filterText_.isEmpty()) {
+                filterMatches_ = candidates;
+            } else {
+                QList<int> subsequenceMatches;
+                for (int index : candidates) {
+                    const QString &label = labelIndex_[index];
+                    if (label.startsWith(filterText_)) {
+                        filterMatches_.append(index);
+                    } else if (matchesActionFilter(label, filterText_)) {
+                        subsequenceMatches.append(index);
+                    }
+                }
+                filterMatches_.append(subsequenceMatches);
+            }
+            if (!filterText_.isEmpty()) {
+                qDebug() << "Action filter" << filterText_ << "matches=" << filterMatches_.size();
+            }
+
+            visibleActions_.clear();
+            visibleActions_.reserve(filterMatches_.size());
+            for (int index : filterMatches_) {
+                visibleActions_.append(actions_[index]);
+            }
+            currentPage_ = 0;
+            rebuildGrid();
+        }
+
+        void triggerAction(int index) {
+            if (index < 0 || index >= visibleActions_.size()) {
+                return;
+            }
+            const MenuAction action = visibleActions_[index];
+            qInfo() << "Menu choice:" << action.label;
+            if (action.handler) {
+                action.handler();
+            }
+            hide();
+        }
+
         void rebuildGrid() {
             while (QLayoutItem *item = grid_->takeAt(0)) {
                 if (item->widget()) {
@@ -505,23 +2303,30 @@ private:
             button->setToolButtonStyle(Qt::ToolButtonIconOnly);
             button->setAutoRaise(true);
             button->setIcon(iconForAction(action));
+            button->setProperty("actionIndex", index);
             button->setToolTip(action.label);
             button->setFixedSize(buttonSize_, buttonSize_);
             button->setIconSize(QSize(iconSize_, iconSize_));
             connect(button, &QToolButton::clicked, this, [this, index]() {
-                if (index < 0 || index >= visibleActions_.size()) {
-                    return;
-                }
-                const MenuAction action = visibleActions_[index];
-                qInfo() << "Menu choice:" << action.label;
-                if (action.handler) {
-                    action.handler();
-                }
-                hide();
+                triggerAction(index);
             });
             return button;
         }
 
+        // Picks up file icons that finished decoding after the grid was built.
+        void refreshActionIcons() {
+            for (int i = 0; i < grid_->count(); ++i) {
+                auto *button = qobject_cast<QToolButton *>(grid_->itemAt(i)->widget());
+                if (!button) {
+                    continue;
+                }
+                const QVariant index = button->property("actionIndex");
+                if (index.isValid() && index.toInt() < visibleActions_.size()) {
+                    button->setIcon(iconForAction(visibleActions_[index.toInt()]));
+                }
+            }
+        }
+
         QToolButton *createNavButton(QStyle::StandardPixmap icon, const QString &tooltip, bool enabled, int delta) {
             auto *button = new QToolButton(this);
             button->setToolButtonStyle(Qt::ToolButtonIconOnly);
@@ -544,6 +2349,9 @@ private:
                 return icon;
             }
             const QString key = action.label.toLower();
+            if (key.startsWith("history")) {
+                return themeIcon({"view-history", "edit-copy"});
+            }
             if (key.contains("uppercase")) {
                 return themeIcon({"format-text-uppercase", "format-text-bold", "format-text"});
             }
@@ -553,223 +2361,986 @@ private:
             if (key.contains("title")) {
                 return themeIcon({"format-text-titlecase", "format-text-underline", "format-text"});
             }
-            if (key.contains("normalize")) {
-                return themeIcon({"edit-clear", "view-refresh"});
+            if (key.contains("normalize")) {
+                return themeIcon({"edit-clear", "view-refresh"});
+            }
+            if (key.contains("paste")) {
+                return themeIcon({"edit-paste"});
+            }
+            if (key.contains("copy")) {
+                return themeIcon({"edit-copy"});
+            }
+            return themeIcon({"text-x-generic", "text-plain", "text"});
+        }
+
+        QIcon themeIcon(const QStringList &names) const {
+            for (const QString &name : names) {
+                if (QIcon::hasThemeIcon(name)) {
+                    return QIcon::fromTheme(name);
+                }
+            }
+            return QIcon();
+        }
+
+        QIcon iconFromSpec(const QString &spec) const {
+            if (spec.isEmpty()) {
+                return QIcon();
+            }
+            if (spec.startsWith("sp:")) {
+                const QString name = spec.mid(3);
+                const QStyle::StandardPixmap pixmap = standardPixmapFromName(name);
+                if (pixmap != QStyle::SP_CustomBase) {
+                    return style()->standardIcon(pixmap);
+                }
+                return QIcon();
+            }
+            const QString filePath = resolveIconPath(spec);
+            if (!filePath.isEmpty()) {
+                return fileIcons_ ? fileIcons_->icon(filePath, iconSize_) : QIcon(filePath);
+            }
+            if (spec.startsWith("file:") || spec.startsWith("~") || QDir::isAbsolutePath(spec)) {
+                return QIcon();
+            }
+            return QIcon::fromTheme(spec);
+        }
+
+        QStyle::StandardPixmap standardPixmapFromName(const QString &name) const {
+            if (name == "SP_ArrowUp") {
+                return QStyle::SP_ArrowUp;
+            }
+            if (name == "SP_ArrowDown") {
+                return QStyle::SP_ArrowDown;
+            }
+            if (name == "SP_ArrowBack") {
+                return QStyle::SP_ArrowBack;
+            }
+            if (name == "SP_ArrowForward") {
+                return QStyle::SP_ArrowForward;
+            }
+            if (name == "SP_FileDialogDetailedView") {
+                return QStyle::SP_FileDialogDetailedView;
+            }
+            if (name == "SP_BrowserReload") {
+                return QStyle::SP_BrowserReload;
+            }
+            if (name == "SP_DialogResetButton") {
+                return QStyle::SP_DialogResetButton;
+            }
+            if (name == "SP_DialogOpenButton") {
+                return QStyle::SP_DialogOpenButton;
+            }
+            if (name == "SP_FileIcon") {
+                return QStyle::SP_FileIcon;
+            }
+            return QStyle::SP_CustomBase;
+        }
+
+    private:
+        QGridLayout *grid_ = nullptr;
+        QList<MenuAction> actions_;
+        QList<MenuAction> visibleActions_;
+        QStringList labelIndex_;
+        QList<int> filterMatches_;
+        QString filterText_;
+        std::function<void()> onClosed_;
+        std::function<QList<MenuAction>(const QString &)> filterProvider_;
+        QElapsedTimer showTimer_;
+        int currentPage_ = 0;
+        int actionIconsPerRow_ = 10;
+        int buttonSize_ = 30;
+        int iconSize_ = kDefaultIconSize;
+        FileIconCache *fileIcons_ = nullptr;
+    };
+
+    void showMenu(const SharedText &text) {
+        if (popupVisible_) {
+            qInfo() << "Popup already visible; skipping.";
+            return;
+        }
+        popupVisible_ = true;
+        if (pollEnabled_) {
+            stopPolling();
+        }
+        const QList<MenuAction> actions = actionsForText(text);
+        qInfo() << "Showing menu with" << actions.size() << "items.";
+        ++popupsShown_;
+        popup().setContent(text, actions);
+        popup().showAtCursor();
+    }
+
+    // An action that reopens the popup on its own list, for families of
+    // actions that would crowd the main popup.
+    MenuAction submenuAction(const QString &label, const QString &icon, const SharedText &text,
+                             const QList<MenuAction> &actions) {
+        return {label, [this, text, actions]() {
+            // Runs after the popup finished hiding from this click.
+            QTimer::singleShot(0, this, [this, text, actions]() {
+                if (popupVisible_) {
+                    return;
+                }
+                popupVisible_ = true;
+                if (pollEnabled_) {
+                    stopPolling();
+                }
+                popup().setContent(text, actions);
+                popup().showAtCursor();
+            });
+        }, true, icon};
+    }
+
+    QList<MenuAction> encodeActions(const SharedText &text) {
+        namespace tx = selaction::text;
+        return {
+            {"Base64 Encode", [this, text]() { encodeToClipboard(text, tx::base64Encode); }, true, "document-encrypt"},
+            {"URL Encode", [this, text]() { encodeToClipboard(text, tx::percentEncode); }, true, "insert-link"},
+            {"Hex Encode", [this, text]() { encodeToClipboard(text, tx::hexEncode); }, true, "code-block"},
+        };
+    }
+
+    QList<MenuAction> digestActions(const SharedText &text) {
+        namespace tx = selaction::text;
+        return {
+            {"SHA-256", [this, text]() { digestToClipboard(text, tx::Sha256); }, true, "security-high"},
+            {"SHA-1", [this, text]() { digestToClipboard(text, tx::Sha1); }, true, "security-medium"},
+            {"MD5", [this, text]() { digestToClipboard(text, tx::Md5); }, true, "security-low"},
+            {"CRC32", [this, text]() { digestToClipboard(text, tx::Crc32); }, true, "checkmark"},
+            {"XXH3", [this, text]() { digestToClipboard(text, tx::Xxh3); }, true, "speedometer"},
+            {"All Digests", [this, text]() { digestToClipboard(text, tx::AllDigests); }, true, "document-properties"},
+        };
+    }
+
+    // Decoders are only offered for text they turn into other text; the
+    // result of a probe is thrown away. everything skips the probe, for the
+    // IPC apply command.
+    QList<MenuAction> decodeActions(const SharedText &text, bool everything) {
+        namespace tx = selaction::text;
+        QList<MenuAction> actions;
+        if (everything || decodesToText(text, tx::base64Decode)) {
+            actions.append({"Base64 Decode", [this, text]() { decodeToClipboard(text, tx::base64Decode, "Base64"); }, true, "document-decrypt"});
+        }
+        if (everything || (text.utf8().contains('%') && decodesToText(text, tx::percentDecode))) {
+            actions.append({"URL Decode", [this, text]() { decodeToClipboard(text, tx::percentDecode, "URL"); }, true, "edit-link"});
+        }
+        if (everything || decodesToText(text, tx::hexDecode)) {
+            actions.append({"Hex Decode", [this, text]() { decodeToClipboard(text, tx::hexDecode, "Hex"); }, true, "code-context"});
+        }
+        return actions;
+    }
+
+    // Only documents are offered the JSON actions; a bare scalar is valid JSON
+    // but reformatting it is pointless.
+    static bool looksLikeJson(QByteArrayView utf8) {
+        for (const char ch : utf8) {
+            if (ch != ' ' && ch != '\n' && ch != '\r' && ch != '\t') {
+                return ch == '{' || ch == '[';
+            }
+        }
+        return false;
+    }
+
+    static bool decodesToText(const SharedText &text, bool (*decode)(QByteArrayView, QByteArray &)) {
+        if (text.utf8().size() > kDecodeProbeBytes) {
+            return false;
+        }
+        QByteArray decoded;
+        return decode(text.utf8(), decoded) && !decoded.isEmpty() && isValidUtf8(decoded);
+    }
+
+    // everything lists grouped and filtered-out actions inline too, so the
+    // IPC apply command can reach every action by label.
+    QList<MenuAction> actionsForText(const SharedText &text, bool everything = false) {
+        QList<MenuAction> actions;
+        namespace tx = selaction::text;
+        actions.append({"UPPERCASE", [this, text]() { setClipboardText(tx::apply(tx::toUpper, text.text())); }, true, "format-text-uppercase"});
+        actions.append({"lowercase", [this, text]() { setClipboardText(tx::apply(tx::toLower, text.text())); }, true, "format-text-lowercase"});
+        actions.append({"Title Case", [this, text]() { setClipboardText(tx::apply(tx::toTitleCase, text.text())); }, true, "format-text-titlecase"});
+        actions.append({"Normalize Whitespace", [this, text]() { setClipboardText(tx::apply(tx::normalizeWhitespace, text.text())); }, true, "edit-clear"});
+        actions.append({"Paste and Match Style", [this, text]() { pasteMatchingStyle(text); }, true, "edit-paste"});
+        actions.append({"Copy to Clipboard", [this, text]() { setClipboardText(text); }, true, "edit-copy"});
+        actions.append(decodeActions(text, everything));
+        if (everything) {
+            actions.append(encodeActions(text));
+        } else {
+            actions.append(submenuAction("Encode", "document-export", text, encodeActions(text)));
+        }
+        if (everything) {
+            actions.append(digestActions(text));
+        } else {
+            actions.append(submenuAction("Digests", "document-edit-sign", text, digestActions(text)));
+        }
+        if (everything || looksLikeJson(text.utf8())) {
+            actions.append({"JSON Pretty", [this, text]() { jsonToClipboard(text, {true, 2, false}); }, true, "format-indent-more"});
+            actions.append({"JSON Minify", [this, text]() { jsonToClipboard(text, {false, 0, false}); }, true, "format-indent-less"});
+            actions.append({"JSON Sort Keys", [this, text]() { jsonToClipboard(text, {true, 2, true}); }, true, "view-sort-ascending"});
+        }
+
+        int historyItems = 0;
+        for (const quint64 fingerprint : history_.recent(kHistoryPopupItems + 1)) {
+            if (fingerprint == lastTextFingerprint_ || historyItems >= kHistoryPopupItems) {
+                continue;
+            }
+            ++historyItems;
+            const QString entry = history_.text(fingerprint);
+            actions.append({"History: " + previewText(entry), [this, fingerprint]() {
+                const QString entry = history_.text(fingerprint);
+                if (!entry.isEmpty()) {
+                    setClipboardText(entry);
+                }
+            }, true, "view-history"});
+        }
+        if (history_.size() > 1) {
+            actions.append({"Search History", [this]() {
+                // Runs after the popup finished hiding from this click.
+                QTimer::singleShot(0, this, [this]() { showHistoryMenu(); });
+            }, true, "edit-find"});
+        }
+
+        const QList<ExternalAction> &externals = externalActions();
+        if (!externals.isEmpty()) {
+            for (const ExternalAction &ext : externals) {
+                actions.append({ext.label, [ext, text]() {
+                    const bool ok = QProcess::startDetached(ext.command, expandArgs(ext.argTemplates, text.text()));
+                    qInfo() << "External action" << ext.command << "started:" << ok;
+                }, true, ext.icon});
+            }
+        }
+
+        return actions;
+    }
+
+    void showHistoryMenu() {
+        if (popupVisible_) {
+            return;
+        }
+        popupVisible_ = true;
+        if (pollEnabled_) {
+            stopPolling();
+        }
+        qInfo() << "Showing history with" << history_.size() << "entries.";
+        popup().setContent(SharedText(), historyActions(QString()));
+        popup().setFilterProvider([this](const QString &query) { return historyActions(query); });
+        popup().showAtCursor();
+    }
+
+    QList<MenuAction> historyActions(const QString &query) {
+        QList<quint64> fingerprints;
+        if (query.trimmed().isEmpty()) {
+            fingerprints = history_.recent(kHistorySearchResults);
+        } else {
+            QElapsedTimer timer;
+            timer.start();
+            HistorySearchIndex::SearchStats searchStats;
+            const QList<HistorySearchIndex::Match> matches =
+                historySearch_.search(query, kHistorySearchResults, history_, &searchStats);
+            for (const HistorySearchIndex::Match &match : matches) {
+                fingerprints.append(match.fingerprint);
+            }
+            qInfo() << "History search entries=" << historySearch_.size() << "candidates=" << searchStats.candidates
+                    << "fuzzy_scanned=" << searchStats.fuzzyScanned << "matches=" << matches.size()
+                    << "us=" << timer.nsecsElapsed() / 1000;
+        }
+
+        QList<MenuAction> actions;
+        for (const quint64 fingerprint : fingerprints) {
+            actions.append({"History: " + previewText(history_.text(fingerprint)), [this, fingerprint]() {
+                const QString entry = history_.text(fingerprint);
+                if (!entry.isEmpty()) {
+                    setClipboardText(entry);
+                }
+            }, true, "view-history"});
+        }
+        return actions;
+    }
+
+    void setClipboardText(const QString &text) {
+        setClipboardText(SharedText::fromString(text));
+    }
+
+    void setClipboardText(const SharedText &text) {
+        suppressNext_ = true;
+        lastText_ = text;
+        recordHistory(text);
+        qInfo() << "Setting clipboard text bytes=" << text.utf8().size();
+        clipboard_->setMimeData(new SharedTextMimeData(text), QClipboard::Clipboard);
+    }
+
+    void encodeToClipboard(const SharedText &text, void (*encode)(QByteArrayView, QByteArray &)) {
+        QByteArray encoded;
+        encode(text.utf8(), encoded);
+        setClipboardText(SharedText::fromUtf8(encoded));
+    }
+
+    // Copies what a worker produced once it is ready; an empty result leaves
+    // the clipboard unchanged.
+    void copyWhenReady(const QFuture<QByteArray> &future) {
+        auto *watcher = new QFutureWatcher<QByteArray>(this);
+        connect(watcher, &QFutureWatcher<QByteArray>::finished, this, [this, watcher]() {
+            const QByteArray result = watcher->result();
+            watcher->deleteLater();
+            if (!result.isEmpty()) {
+                setClipboardText(SharedText::fromUtf8(result));
+            }
+        });
+        watcher->setFuture(future);
+    }
+
+    // A single digest is copied bare, several as one "NAME  hex" line each.
+    void digestToClipboard(const SharedText &text, quint32 digests) {
+        copyWhenReady(QtConcurrent::run([text, digests]() {
+            QElapsedTimer timer;
+            timer.start();
+            const QList<selaction::text::DigestResult> results = selaction::text::digest(text.utf8(), digests);
+            qInfo() << "Digests computed count=" << results.size() << "bytes=" << text.utf8().size()
+                    << "ms=" << timer.elapsed();
+            if (results.size() != qsizetype(qPopulationCount(digests))) {
+                qWarning() << "Digest state allocation failed; leaving the clipboard unchanged.";
+                return QByteArray();
+            }
+            if (results.size() == 1) {
+                return results.first().hex;
             }
-            if (key.contains("paste")) {
-                return themeIcon({"edit-paste"});
+            QByteArray lines;
+            for (const selaction::text::DigestResult &result : results) {
+                lines += result.name.toUtf8() + "  " + result.hex + '\n';
             }
-            if (key.contains("copy")) {
-                return themeIcon({"edit-copy"});
+            return lines.trimmed();
+        }));
+    }
+
+    void jsonToClipboard(const SharedText &text, const selaction::text::JsonFormatOptions &options) {
+        copyWhenReady(QtConcurrent::run([this, text, options]() {
+            QByteArray formatted;
+            const selaction::text::JsonError error = selaction::text::reformatJson(text.utf8(), formatted, options);
+            if (!error.ok()) {
+                QMetaObject::invokeMethod(this, [this, error]() {
+                    notifyFailure("Invalid JSON", QString("%1 at byte %2.").arg(error.message).arg(error.offset));
+                }, Qt::QueuedConnection);
+                return QByteArray();
             }
-            return themeIcon({"text-x-generic", "text-plain", "text"});
+            return formatted;
+        }));
+    }
+
+    // Decoders are strict; malformed input or a result that is not text
+    // leaves the clipboard unchanged and tells the user why.
+    void decodeToClipboard(const SharedText &text, bool (*decode)(QByteArrayView, QByteArray &), const char *codec) {
+        QByteArray decoded;
+        if (!decode(text.utf8(), decoded)) {
+            notifyFailure(QString("%1 decode failed").arg(codec), "The selection is not valid input.");
+            return;
+        }
+        if (!isValidUtf8(decoded)) {
+            notifyFailure(QString("%1 decode failed").arg(codec),
+                          QString("The result (%1 bytes) is not UTF-8 text.").arg(decoded.size()));
+            return;
         }
+        setClipboardText(SharedText::fromUtf8(decoded));
+    }
 
-        QIcon themeIcon(const QStringList &names) const {
-            for (const QString &name : names) {
-                if (QIcon::hasThemeIcon(name)) {
-                    return QIcon::fromTheme(name);
-                }
-            }
-            return QIcon();
+    // Actions run from a popup that is already gone, so failures are shown as
+    // a desktop notification (when notify-send exists) as well as logged.
+    void notifyFailure(const QString &summary, const QString &body) {
+        qWarning().noquote() << summary + ":" << body;
+        if (!QProcess::startDetached("notify-send", {"--app-name=selaction", "--icon=dialog-warning", summary, body})) {
+            qDebug() << "notify-send unavailable";
         }
+    }
 
-        QIcon iconFromSpec(const QString &spec) const {
-            if (spec.isEmpty()) {
-                return QIcon();
-            }
-            if (spec.startsWith("sp:")) {
-                const QString name = spec.mid(3);
-                const QStyle::StandardPixmap pixmap = standardPixmapFromName(name);
-                if (pixmap != QStyle::SP_CustomBase) {
-                    return style()->standardIcon(pixmap);
+    // When the source of text also offers HTML, the stripped HTML keeps the
+    // paragraph and table structure that text/plain often loses. The HTML is
+    // read the same way as the text itself: through wl-paste off the GUI
+    // thread for sources that go through it, otherwise through a timed
+    // QClipboard read that counts towards the stall fallback.
+    AsyncTask pasteMatchingStyle(SharedText text) {
+        for (const QClipboard::Mode mode : {QClipboard::Selection, QClipboard::Clipboard}) {
+            QString html;
+            if (readsThroughWlPaste(mode)) {
+                const QStringList args = mode == QClipboard::Clipboard ? QStringList() : QStringList{"--primary"};
+                const ProcessResult plain = co_await runProcess(this, "wl-paste", args, 200);
+                if (!plain.ok || !isValidUtf8(plain.output)
+                    || QString::fromUtf8(trimClipboardText(plain.output)) != text.text()) {
+                    continue;
+                }
+                const ProcessResult rich =
+                    co_await runProcess(this, "wl-paste", args + QStringList{"--type", "text/html"}, 200);
+                if (!rich.ok || !isValidUtf8(rich.output)) {
+                    continue;
+                }
+                html = QString::fromUtf8(rich.output);
+            } else {
+                if (stallFallbackActive(mode)) {
+                    continue;
+                }
+                QElapsedTimer timer;
+                timer.start();
+                const QMimeData *mime = clipboard_->mimeData(mode);
+                const bool matches = mime && mime->hasHtml() && trimClipboardText(mime->text()) == text.text();
+                if (matches) {
+                    html = mime->html();
+                }
+                noteQtRead(mode, timer.elapsed());
+                if (!matches) {
+                    continue;
                 }
-                return QIcon();
-            }
-            const QString filePath = resolveIconPath(spec);
-            if (!filePath.isEmpty()) {
-                return QIcon(filePath);
             }
-            if (spec.startsWith("file:") || spec.startsWith("~") || QDir::isAbsolutePath(spec)) {
-                return QIcon();
+            QString plain;
+            selaction::text::htmlToPlainText(html, plain);
+            if (!plain.isEmpty()) {
+                qInfo() << "Paste and Match Style: stripped HTML from mode" << mode;
+                setClipboardPlainText(plain);
+                co_return;
             }
-            return QIcon::fromTheme(spec);
         }
+        setClipboardPlainText(text.text());
+    }
 
-        QString resolveIconPath(const QString &spec) const {
-            if (spec.startsWith("file:")) {
-                const QString localPath = QUrl(spec).toLocalFile();
-                if (QFileInfo::exists(localPath)) {
-                    return localPath;
-                }
-                return QString();
-            }
-            QString path = spec;
-            if (spec.startsWith("~")) {
-                path = QDir::homePath() + spec.mid(1);
-            }
-            if (QDir::isAbsolutePath(path) && QFileInfo::exists(path)) {
-                return path;
-            }
-            return QString();
+    void setClipboardPlainText(const QString &text) {
+        suppressNext_ = true;
+        lastText_ = SharedText::fromString(text);
+        recordHistory(lastText_);
+        qInfo() << "Setting clipboard plain text len=" << text.size();
+        clipboard_->setMimeData(new SharedTextMimeData(lastText_), QClipboard::Clipboard);
+    }
+
+    void reloadSettings() {
+        applySettings(withEnvironmentOverrides(loadSettings()));
+        externalActions_.reset();
+        externalActions();
+        qInfo() << "Settings reloaded.";
+    }
+
+    // Applies settings on startup and on every reload; only the parts that
+    // changed take effect beyond updating the stored values.
+    void applySettings(const AppSettings &effective) {
+        gMinLogLevel = logLevelFromString(effective.logLevel);
+
+        if (effective.wlPasteEnabled && (!wlPasteEnabled_ || effective.wlPasteMode != wlPasteMode_)) {
+            qInfo() << "wl-paste fallback enabled";
+            qInfo() << "wl-paste mode:" << effective.wlPasteMode;
         }
+        const bool sourcesChanged = wlPasteEnabled_ != effective.wlPasteEnabled || wlPasteMode_ != effective.wlPasteMode;
+        wlPasteEnabled_ = effective.wlPasteEnabled;
+        wlPasteMode_ = effective.wlPasteMode;
 
-        QStyle::StandardPixmap standardPixmapFromName(const QString &name) const {
-            if (name == "SP_ArrowUp") {
-                return QStyle::SP_ArrowUp;
-            }
-            if (name == "SP_ArrowDown") {
-                return QStyle::SP_ArrowDown;
-            }
-            if (name == "SP_ArrowBack") {
-                return QStyle::SP_ArrowBack;
-            }
-            if (name == "SP_ArrowForward") {
-                return QStyle::SP_ArrowForward;
-            }
-            if (name == "SP_FileDialogDetailedView") {
-                return QStyle::SP_FileDialogDetailedView;
-            }
-            if (name == "SP_BrowserReload") {
-                return QStyle::SP_BrowserReload;
-            }
-            if (name == "SP_DialogResetButton") {
-                return QStyle::SP_DialogResetButton;
-            }
-            if (name == "SP_DialogOpenButton") {
-                return QStyle::SP_DialogOpenButton;
-            }
-            if (name == "SP_FileIcon") {
-                return QStyle::SP_FileIcon;
+        actionIconsPerRow_ = effective.actionIconsPerRow;
+        if (popup_) {
+            popup_->setActionIconsPerRow(actionIconsPerRow_);
+        }
+
+        history_.setByteBudget(effective.historyBytes);
+        const bool persist = effective.historyPersist && effective.historyBytes > 0;
+        if (persist && !historyLog_.isOpen()) {
+            openHistoryLog(effective.historyCompress);
+        } else if (!persist && historyLog_.isOpen()) {
+            historyLog_.close();
+            qInfo() << "History persistence disabled";
+        }
+        historyLog_.setCompression(effective.historyCompress);
+
+        idleDropPopup_ = effective.idleDropPopup;
+        // QTimer intervals are int milliseconds; a day is plenty for "idle".
+        const int idleSeconds = qBound(0, effective.idleCompactSeconds, kMaxIdleCompactSeconds);
+        idleTimer_.setInterval(std::chrono::seconds(idleSeconds));
+        if (idleSeconds > 0) {
+            noteActivity();
+        } else {
+            idleTimer_.stop();
+        }
+
+        const bool pollWasEnabled = pollEnabled_;
+        pollEnabled_ = effective.pollEnabled;
+        const bool intervalChanged = pollIntervalMs_ != effective.pollIntervalMs;
+        if (intervalChanged || !pollWasEnabled) {
+            pollIntervalMs_ = effective.pollIntervalMs;
+            // Re-arms the timer if it is running.
+            pollTimer_.setInterval(pollIntervalMs_);
+            if (pollEnabled_) {
+                qInfo() << "Polling enabled" << "interval_ms=" << pollIntervalMs_;
             }
-            return QStyle::SP_CustomBase;
         }
+        if (pollEnabled_ && !pollWasEnabled) {
+            // Content that was already there when we last ran is not a change, so
+            // polling can start right away. Without a saved baseline the first
+            // sample of each source only records the current content.
+            baselineOnlyModes_ = loadBaseline() ? 0 : (kClipboardBit | kSelectionBit);
+            QTimer::singleShot(0, this, [this]() {
+                if (pollEnabled_ && !popupVisible_) {
+                    pollClipboard();
+                    startPolling();
+                }
+            });
+        } else if (!pollEnabled_ && pollWasEnabled) {
+            stopPolling();
+            qInfo() << "Polling disabled";
+        } else if (sourcesChanged || intervalChanged) {
+            restartPolling();
+        }
+    }
 
-    private:
-        QGridLayout *grid_ = nullptr;
-        QList<MenuAction> actions_;
-        QList<MenuAction> visibleActions_;
-        std::function<void()> onClosed_;
-        QElapsedTimer showTimer_;
-        int currentPage_ = 0;
-        int actionIconsPerRow_ = 10;
-        int buttonSize_ = 30;
-        int iconSize_ = 20;
-    };
+    void noteActivity() {
+        if (idleTimer_.interval() > 0) {
+            idleTimer_.start();
+        }
+    }
 
-    void showMenu(const QString &text) {
+    // The daemon spends nearly all its time waiting, so after a quiet period
+    // it lets go of everything that is cheap to rebuild on the next popup.
+    void compactWhenIdle() {
         if (popupVisible_) {
-            qInfo() << "Popup already visible; skipping.";
+            noteActivity();
             return;
         }
-        popupVisible_ = true;
-        if (pollEnabled_) {
-            pollTimer_.stop();
+        const qint64 before = residentBytes();
+        lastText_ = SharedText();
+        externalActions_.reset();
+        if (popup_) {
+            if (idleDropPopup_) {
+                popup_.reset();
+                fileIcons_.clear();
+            } else {
+                popup_->clearContent();
+            }
         }
-        QList<MenuAction> actions;
-        actions.append({"UPPERCASE", [this, text]() { setClipboardText(text.toUpper()); }, true, "format-text-uppercase"});
-        actions.append({"lowercase", [this, text]() { setClipboardText(text.toLower()); }, true, "format-text-lowercase"});
-        actions.append({"Title Case", [this, text]() { setClipboardText(toTitleCase(text)); }, true, "format-text-titlecase"});
-        actions.append({"Normalize Whitespace", [this, text]() { setClipboardText(normalizeWhitespace(text)); }, true, "edit-clear"});
-        actions.append({"Paste and Match Style", [this, text]() { setClipboardPlainText(text); }, true, "edit-paste"});
-        actions.append({"Copy to Clipboard", [this, text]() { setClipboardText(text); }, true, "edit-copy"});
+        releaseFreeHeap();
+        const qint64 after = residentBytes();
+        qInfo() << "Idle compaction rss_kb before=" << before / 1024 << "after=" << after / 1024
+                << "dropped_popup=" << idleDropPopup_;
+    }
 
-        QList<ExternalAction> externals = loadExternalActions();
-        if (!externals.isEmpty()) {
-            for (const ExternalAction &ext : externals) {
-                actions.append({ext.label, [ext, text]() {
-                    const bool ok = QProcess::startDetached(ext.command, expandArgs(ext.args, text));
-                    qInfo() << "External action" << ext.command << "started:" << ok;
-                }, true, ext.icon});
+    void watchConfig() {
+        configReload_.setSingleShot(true);
+        configReload_.setInterval(250);
+        connect(&configReload_, &QTimer::timeout, this, [this]() {
+            watchConfigPaths();
+            reloadSettings();
+        });
+        // Editors often save by replacing the file, which drops it from the
+        // watcher, so the directory is watched as well.
+        connect(&configWatcher_, &QFileSystemWatcher::fileChanged, &configReload_, qOverload<>(&QTimer::start));
+        connect(&configWatcher_, &QFileSystemWatcher::directoryChanged, &configReload_, qOverload<>(&QTimer::start));
+        watchConfigPaths();
+    }
+
+    void watchConfigPaths() {
+        const QString configRoot = QStandardPaths::writableLocation(QStandardPaths::ConfigLocation);
+        const QString configDir = configRoot + "/selaction";
+        const QStringList watched = configWatcher_.files() + configWatcher_.directories();
+        for (const QString &path : {configDir, configDir + "/settings.json", configDir + "/actions.json"}) {
+            if (!watched.contains(path) && QFileInfo::exists(path)) {
+                configWatcher_.addPath(path);
             }
         }
+        // Until our directory exists, its parent is watched so creating it is
+        // noticed; afterwards the parent's unrelated churn is not.
+        const bool dirExists = QFileInfo::exists(configDir);
+        if (!dirExists && !watched.contains(configRoot) && QFileInfo::exists(configRoot)) {
+            configWatcher_.addPath(configRoot);
+        } else if (dirExists && watched.contains(configRoot)) {
+            configWatcher_.removePath(configRoot);
+        }
+    }
 
-        qInfo() << "Showing menu with" << actions.size() << "items.";
-        popup_.setContent(text, actions);
-        popup_.showAtCursor();
+    ActionPopup &popup() {
+        if (!popup_) {
+            popup_ = std::make_unique<ActionPopup>();
+            popup_->setActionIconsPerRow(actionIconsPerRow_);
+            popup_->setFileIconCache(&fileIcons_);
+            popup_->setOnClosed([this]() {
+                popupVisible_ = false;
+                noteActivity();
+                nextAllowedPopupMs_ = popupTimer_.elapsed() + 800;
+                if (pollEnabled_) {
+                    QTimer::singleShot(300, this, [this]() {
+                        if (pollEnabled_ && !popupVisible_) {
+                            startPolling();
+                        }
+                    });
+                }
+            });
+        }
+        return *popup_;
     }
 
-    void setClipboardText(const QString &text) {
-        suppressNext_ = true;
-        lastText_ = text;
-        qInfo() << "Setting clipboard text len=" << text.size();
-        clipboard_->setText(text);
+    const QList<ExternalAction> &externalActions() {
+        if (!externalActions_) {
+            externalActions_ = loadExternalActions();
+            QStringList iconFiles;
+            for (const ExternalAction &action : *externalActions_) {
+                const QString path = resolveIconPath(action.icon);
+                if (!path.isEmpty()) {
+                    iconFiles.append(path);
+                }
+            }
+            fileIcons_.prefetch(iconFiles, ActionPopup::kDefaultIconSize);
+        }
+        return *externalActions_;
     }
 
-    void setClipboardPlainText(const QString &text) {
-        suppressNext_ = true;
-        lastText_ = text;
-        qInfo() << "Setting clipboard plain text len=" << text.size();
-        auto *mime = new QMimeData();
-        mime->setText(text);
-        clipboard_->setMimeData(mime, QClipboard::Clipboard);
+    void openHistoryLog(bool compress) {
+        const QString dataDir = QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation);
+        if (!historyLog_.open(dataDir + "/selaction")) {
+            return;
+        }
+        historyLog_.setCompression(compress);
+
+        QElapsedTimer timer;
+        timer.start();
+        const qint64 rssBefore = residentBytes();
+        const QList<HistoryLog::LoadedEntry> loaded = historyLog_.load(history_.byteBudget());
+        for (const HistoryLog::LoadedEntry &entry : loaded) {
+            history_.add(entry.utf8, entry.timestampMs);
+        }
+        const qint64 rssAfter = residentBytes();
+        qInfo() << "History restored entries=" << history_.size() << "ms=" << timer.elapsed()
+                << "rss_kb before=" << rssBefore / 1024 << "after=" << rssAfter / 1024;
+        logHistoryStats();
+        compactHistoryLogIfNeeded();
+    }
+
+    void logHistoryStats() const {
+        const ClipboardHistory::Stats stats = history_.stats();
+        qInfo() << "History stats entries=" << stats.entries << "chunks=" << stats.chunks
+                << "logical_bytes=" << stats.logicalBytes << "stored_bytes=" << stats.storedBytes
+                << "overhead_bytes=" << stats.overheadBytes << "arena_bytes=" << stats.arenaBytes << "dedup_ratio=" << stats.dedupRatio()
+                << "disk_bytes=" << (historyLog_.isOpen() ? historyLog_.diskBytes() : 0);
+    }
+
+    quint64 recordHistory(const SharedText &text) {
+        const qint64 now = QDateTime::currentMSecsSinceEpoch();
+        const quint64 fingerprint = history_.add(text.utf8(), now, text.fingerprint());
+        if (fingerprint != 0 && historyLog_.isOpen()) {
+            historyLog_.append(fingerprint, text.utf8(), now);
+            compactHistoryLogIfNeeded();
+        }
+        return fingerprint;
+    }
+
+    void compactHistoryLogIfNeeded() {
+        if (!historyLog_.needsCompaction(history_.size())) {
+            return;
+        }
+        QList<quint64> live = history_.recent(history_.size());
+        std::reverse(live.begin(), live.end());
+        historyLog_.compact(live);
     }
 
     void logClipboardState(const char *prefix, QClipboard::Mode mode) {
-        const QString text = clipboard_->text(mode).trimmed();
+        const QString text = trimClipboardText(clipboard_->text(mode));
         qInfo() << prefix << "mode" << mode << "len=" << text.size()
                 << "preview=" << previewText(text);
     }
 
-    void pollClipboard() {
-        QString clip = clipboard_->text(QClipboard::Clipboard).trimmed();
-        QString sel = clipboard_->text(QClipboard::Selection).trimmed();
+    bool readsThroughWlPaste(QClipboard::Mode mode) const {
+        if (wlPasteEnabled_
+            && (mode == QClipboard::Clipboard ? wlPasteMode_ != "primary" : wlPasteMode_ != "clipboard")) {
+            return true;
+        }
+        return wlPasteAvailable_ && stallFallbackActive(mode);
+    }
 
-        if (wlPasteEnabled_) {
-            bool okClipboard = false;
-            bool okSelection = false;
-            QString wlClip;
-            QString wlSel;
-            if (wlPasteMode_ != "primary") {
-                wlClip = readWlPaste({}, 200, &okClipboard);
-                if (okClipboard && !wlClip.isEmpty()) {
-                    clip = wlClip;
-                }
+    bool stallFallbackActive(QClipboard::Mode mode) const {
+        return readStats_[statsIndex(mode)].fallbackUntilMs > popupTimer_.elapsed();
+    }
+
+    static int statsIndex(QClipboard::Mode mode) {
+        return mode == QClipboard::Selection ? 1 : 0;
+    }
+
+    // Qt clipboard reads are synchronous and a slow selection owner (e.g. a
+    // hung XWayland client) blocks them, so they cannot be cut short. Each read
+    // is timed instead; a source that overran its budget is read through
+    // wl-paste, off the GUI thread, for the next kStallFallbackMs.
+    SharedText readQtClipboard(QClipboard::Mode mode) {
+        QElapsedTimer timer;
+        timer.start();
+        const QString text = trimClipboardText(clipboard_->text(mode));
+        noteQtRead(mode, timer.elapsed());
+        return SharedText::fromString(text);
+    }
+
+    // Books one timed QClipboard read of mode; an overrun starts the wl-paste
+    // fallback for that source.
+    void noteQtRead(QClipboard::Mode mode, qint64 elapsedMs) {
+        SourceReadStats &stats = readStats_[statsIndex(mode)];
+        ++stats.reads;
+        stats.worstMs = qMax(stats.worstMs, elapsedMs);
+        if (elapsedMs > kReadBudgetMs) {
+            ++stats.stalls;
+            if (!wlPasteChecked_) {
+                wlPasteChecked_ = true;
+                wlPasteAvailable_ = !QStandardPaths::findExecutable("wl-paste").isEmpty();
             }
-            if (wlPasteMode_ != "clipboard") {
-                wlSel = readWlPaste({"--primary"}, 200, &okSelection);
-                if (okSelection && !wlSel.isEmpty()) {
-                    sel = wlSel;
+            const bool fallbackWasActive = readsThroughWlPaste(mode);
+            stats.fallbackUntilMs = popupTimer_.elapsed() + kStallFallbackMs;
+            qWarning() << "Clipboard read stalled mode" << mode << "ms=" << elapsedMs << "stalls=" << stats.stalls
+                       << "fallback=" << (wlPasteAvailable_ ? "wl-paste" : "none");
+            if (wlPasteAvailable_) {
+                if (!fallbackWasActive) {
+                    restartPolling();
                 }
+                scheduleFallbackEnd();
             }
-            if (traceEnabled_) {
-                qInfo() << "Trace: wl-paste ok=" << okClipboard << "len=" << wlClip.size();
-                qInfo() << "Trace: wl-paste --primary ok=" << okSelection << "len=" << wlSel.size();
+        }
+    }
+
+    // Arms the one fallback timer for the earliest stall fallback still
+    // running, so the sources are re-partitioned once it ends; repeated
+    // stalls restart it instead of queueing more timers.
+    void scheduleFallbackEnd() {
+        const qint64 now = popupTimer_.elapsed();
+        qint64 next = 0;
+        for (const SourceReadStats &stats : readStats_) {
+            if (stats.fallbackUntilMs > now && (next == 0 || stats.fallbackUntilMs < next)) {
+                next = stats.fallbackUntilMs;
             }
         }
+        if (next == 0) {
+            fallbackEnd_.stop();
+            return;
+        }
+        fallbackEnd_.start(int(next - now + 100));
+    }
 
-        if (traceEnabled_) {
-            qInfo() << "Trace: clipboard len=" << clip.size() << "preview=" << previewText(clip);
-            qInfo() << "Trace: selection len=" << sel.size() << "preview=" << previewText(sel);
+    // Re-partitions sources between the GUI thread and the I/O thread.
+    void restartPolling() {
+        if (pollEnabled_ && !popupVisible_) {
+            stopPolling();
+            startPolling();
         }
+    }
+
+    // Sources read through wl-paste are sampled on the I/O thread; the GUI
+    // thread only polls what has to go through QClipboard.
+    void startPolling() {
+        QList<QClipboard::Mode> wlPasteModes;
+        for (const QClipboard::Mode mode : {QClipboard::Clipboard, QClipboard::Selection}) {
+            if (readsThroughWlPaste(mode)) {
+                wlPasteModes.append(mode);
+            }
+        }
+        if (wlPasteModes.size() < 2) {
+            pollTimer_.start();
+        }
+        if (!wlPasteModes.isEmpty()) {
+            if (!ioThread_.isRunning()) {
+                ioThread_.start();
+            }
+            WlPasteReader *reader = sourceReader_;
+            const int intervalMs = pollIntervalMs_;
+            QMetaObject::invokeMethod(reader, [reader, wlPasteModes, intervalMs]() {
+                reader->start(wlPasteModes, intervalMs);
+            }, Qt::QueuedConnection);
+        }
+    }
+
+    void stopPolling() {
+        pollTimer_.stop();
+        if (ioThread_.isRunning()) {
+            WlPasteReader *reader = sourceReader_;
+            QMetaObject::invokeMethod(reader, [reader]() { reader->stop(); }, Qt::QueuedConnection);
+        }
+    }
+
+    void pollClipboard() {
+        for (const QClipboard::Mode mode : {QClipboard::Clipboard, QClipboard::Selection}) {
+            if (!readsThroughWlPaste(mode)) {
+                evaluateSample(mode, readQtClipboard(mode));
+            }
+        }
+    }
 
-        if (clip != lastClipboardText_) {
-            lastClipboardText_ = clip;
-            if (!clip.isEmpty()) {
-                qInfo() << "Poll: clipboard changed len=" << clip.size();
-                pendingMode_ = QClipboard::Clipboard;
-                showMenuIfNeededWithText(clip);
+    void drainSourceEvents() {
+        sourceReader_->beginDrain();
+        SourceEvent event;
+        while (sourceReader_->next(event)) {
+            if (event.text.isNull()) {
+                // The source is on wl-paste because QClipboard stalled on it;
+                // retrying through QClipboard would block the GUI thread again.
+                if (stallFallbackActive(event.mode)) {
+                    continue;
+                }
+                event.text = readQtClipboard(event.mode);
             }
+            evaluateSample(event.mode, event.text);
+        }
+    }
+
+    void evaluateSample(QClipboard::Mode mode, const SharedText &text) {
+        const bool selection = mode == QClipboard::Selection;
+        if (traceEnabled_) {
+            qInfo() << "Trace:" << (selection ? "selection" : "clipboard") << "bytes=" << text.utf8().size()
+                    << "preview=" << previewText(text.text());
+        }
+        quint64 &last = selection ? lastSelectionFingerprint_ : lastClipboardFingerprint_;
+        const quint64 fingerprint = text.fingerprint();
+        const int bit = selection ? kSelectionBit : kClipboardBit;
+        if (baselineOnlyModes_ & bit) {
+            baselineOnlyModes_ &= ~bit;
+            last = fingerprint;
+            scheduleBaselineSave();
+            return;
+        }
+        if (fingerprint == last) {
+            return;
+        }
+        last = fingerprint;
+        scheduleBaselineSave();
+        if (!text.isEmpty()) {
+            qInfo() << "Poll:" << (selection ? "selection" : "clipboard") << "changed bytes=" << text.utf8().size();
+            onPolledChange(text);
+        }
+    }
+
+    void onPolledChange(const SharedText &text) {
+        // Newer than anything a signal-driven ingest is still waiting on.
+        ++ingestGeneration_;
+        if (popupVisible_) {
+            recordHistory(text);
+            qInfo() << "Popup already visible; skipping.";
+            return;
+        }
+        showMenuIfNeededWithText(text);
+    }
+
+    // One run per change signal: debounce, read, then show. A newer change
+    // supersedes it at every suspension point.
+    AsyncTask ingest(QClipboard::Mode mode) {
+        const quint64 generation = ++ingestGeneration_;
+        co_await delay(this, kDebounceMs);
+        if (generation != ingestGeneration_) {
+            co_return;
         }
 
-        if (sel != lastSelectionText_) {
-            lastSelectionText_ = sel;
-            if (!sel.isEmpty()) {
-                qInfo() << "Poll: selection changed len=" << sel.size();
-                pendingMode_ = QClipboard::Selection;
-                showMenuIfNeededWithText(sel);
+        SharedText text;
+        if (readsThroughWlPaste(mode)) {
+            const QStringList args = mode == QClipboard::Clipboard ? QStringList() : QStringList{"--primary"};
+            const ProcessResult result = co_await runProcess(this, "wl-paste", args, 200);
+            if (generation != ingestGeneration_) {
+                co_return;
             }
+            if (result.ok && isValidUtf8(result.output)) {
+                const QByteArray output = trimClipboardText(result.output);
+                if (!output.isEmpty()) {
+                    text = SharedText::fromUtf8(output);
+                }
+            }
+        }
+        if (text.isNull()) {
+            text = readQtClipboard(mode);
+        }
+
+        if (pollEnabled_) {
+            // Keep the poll from re-announcing a change the signal already handled.
+            quint64 &baseline = mode == QClipboard::Selection ? lastSelectionFingerprint_ : lastClipboardFingerprint_;
+            baseline = text.fingerprint();
+            scheduleBaselineSave();
+        }
+        qInfo() << "Evaluating text from mode" << mode
+                << "len=" << text.text().size() << "preview=" << previewText(text.text());
+        showMenuIfNeededWithText(text);
+    }
+
+    QString baselinePath() const {
+        return QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) + "/selaction/baseline.json";
+    }
+
+    // Fingerprints of the last clipboard and selection contents we saw, so a
+    // restart can tell real changes from content that was already there.
+    bool loadBaseline() {
+        QFile file(baselinePath());
+        if (!file.open(QIODevice::ReadOnly)) {
+            return false;
         }
+        const QJsonObject obj = QJsonDocument::fromJson(file.readAll()).object();
+        bool okClipboard = false;
+        bool okSelection = false;
+        const quint64 clipboard = obj.value("clipboard").toString().toULongLong(&okClipboard, 16);
+        const quint64 selection = obj.value("selection").toString().toULongLong(&okSelection, 16);
+        if (!okClipboard || !okSelection) {
+            qWarning() << "Ignoring invalid baseline" << file.fileName();
+            return false;
+        }
+        lastClipboardFingerprint_ = savedClipboardFingerprint_ = clipboard;
+        lastSelectionFingerprint_ = savedSelectionFingerprint_ = selection;
+        return true;
+    }
+
+    // The baseline only matters across restarts, so changes are written after a
+    // quiet period and on quit rather than once per clipboard change.
+    void scheduleBaselineSave() {
+        if (pollEnabled_ && !baselineSave_.isActive()) {
+            baselineSave_.start();
+        }
+    }
+
+    void saveBaseline() {
+        baselineSave_.stop();
+        if (!pollEnabled_ || (lastClipboardFingerprint_ == savedClipboardFingerprint_
+                              && lastSelectionFingerprint_ == savedSelectionFingerprint_)) {
+            return;
+        }
+        const QString path = baselinePath();
+        QDir().mkpath(QFileInfo(path).absolutePath());
+        QJsonObject obj;
+        obj.insert("clipboard", QString::number(lastClipboardFingerprint_, 16));
+        obj.insert("selection", QString::number(lastSelectionFingerprint_, 16));
+        QSaveFile file(path);
+        if (!file.open(QIODevice::WriteOnly)) {
+            return;
+        }
+        file.write(QJsonDocument(obj).toJson(QJsonDocument::Compact));
+        if (!file.commit()) {
+            qWarning() << "Cannot write baseline" << path;
+            return;
+        }
+        savedClipboardFingerprint_ = lastClipboardFingerprint_;
+        savedSelectionFingerprint_ = lastSelectionFingerprint_;
     }
 
     QClipboard *clipboard_ = nullptr;
-    QClipboard::Mode pendingMode_ = QClipboard::Clipboard;
-    QTimer debounce_;
     QTimer pollTimer_;
-    ActionPopup popup_;
-    QString lastText_;
-    QString lastClipboardText_;
-    QString lastSelectionText_;
+    QTimer configReload_;
+    QTimer idleTimer_;
+    QTimer baselineSave_;
+    QTimer fallbackEnd_;
+    QFileSystemWatcher configWatcher_;
+    static constexpr int kHistoryPopupItems = 5;
+    static constexpr int kHistorySearchResults = 50;
+    static constexpr int kBaselineSaveDelayMs = 5000;
+    static constexpr qsizetype kDecodeProbeBytes = 1024 * 1024;
+    static constexpr int kMaxIdleCompactSeconds = 24 * 60 * 60;
+
+    static constexpr int kWarmUpDelayMs = 3000;
+    static constexpr int kDebounceMs = 120;
+    static constexpr qint64 kReadBudgetMs = 50;
+    static constexpr qint64 kStallFallbackMs = 60 * 1000;
+
+    struct SourceReadStats {
+        int reads = 0;
+        int stalls = 0;
+        qint64 worstMs = 0;
+        // popupTimer_ time until which the source is read through wl-paste.
+        qint64 fallbackUntilMs = 0;
+    };
+
+    FileIconCache fileIcons_;
+    std::unique_ptr<ActionPopup> popup_;
+    std::optional<QList<ExternalAction>> externalActions_;
+    int actionIconsPerRow_ = 10;
+    ClipboardHistory history_;
+    HistorySearchIndex historySearch_;
+    HistoryLog historyLog_;
+    SharedText lastText_;
+    quint64 lastTextFingerprint_ = 0;
+    quint64 ingestGeneration_ = 0;
+    quint64 lastClipboardFingerprint_ = 0;
+    quint64 lastSelectionFingerprint_ = 0;
+    quint64 savedClipboardFingerprint_ = 0;
+    quint64 savedSelectionFingerprint_ = 0;
+    static constexpr int kClipboardBit = 0x1;
+    static constexpr int kSelectionBit = 0x2;
+    // Sources whose next sample only records the baseline.
+    int baselineOnlyModes_ = 0;
     bool suppressNext_ = false;
     bool pollEnabled_ = false;
     bool traceEnabled_ = false;
@@ -777,23 +3348,100 @@ private:
     bool popupVisible_ = false;
     QElapsedTimer popupTimer_;
     qint64 nextAllowedPopupMs_ = 0;
+    int popupsShown_ = 0;
+    bool idleDropPopup_ = false;
     int pollIntervalMs_ = 1500;
     QString wlPasteMode_ = "primary";
+    QThread ioThread_;
+    // Lives on ioThread_ and is deleted there; see the destructor.
+    WlPasteReader *sourceReader_ = nullptr;
+    std::array<SourceReadStats, 2> readStats_;
+    bool wlPasteChecked_ = false;
+    bool wlPasteAvailable_ = false;
 };
 
 } // namespace
 
 int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        if (qstrcmp(argv[i], "--batch") == 0) {
+            return runBatch(argc, argv);
+        }
+    }
+
+    // A command for the running daemon is either the whole argument list when
+    // it starts with a word, or whatever follows "--". Anything else is left
+    // to QApplication, so Qt options with values such as "-platform xcb" work.
+    QStringList command;
+    int commandStart = argc;
+    if (argc > 1 && argv[1][0] != '-') {
+        commandStart = 1;
+    } else {
+        for (int i = 1; i < argc; ++i) {
+            if (qstrcmp(argv[i], "--") == 0) {
+                commandStart = i + 1;
+                break;
+            }
+        }
+    }
+    for (int i = commandStart; i < argc; ++i) {
+        command.append(QString::fromLocal8Bit(argv[i]));
+    }
+
+    gStartupProfile.start();
+    const QString socketPath = commandSocketPath();
+    int exitCode = 0;
+    if (sendCommand(socketPath, command.isEmpty() ? QStringList{"ping"} : command, &exitCode)) {
+        return exitCode;
+    }
+    if (!command.isEmpty()) {
+        std::fprintf(stderr, "selaction is not running.\n");
+        return 1;
+    }
+
+    gStartupProfile.verbose = qEnvironmentVariableIsSet("SELACTION_PROFILE_STARTUP");
+    for (int i = 1; i < argc; ++i) {
+        if (qstrcmp(argv[i], "--profile-startup") == 0) {
+            gStartupProfile.verbose = true;
+        }
+    }
+    gStartupProfile.mark("client_probe");
+
+    // Claimed before anything is built, so two daemons started at once cannot
+    // both get past the probe above. A lock left by a dead process is stale
+    // and taken over.
+    QLockFile instanceLock(socketPath + ".lock");
+    instanceLock.setStaleLockTime(0);
+    if (!instanceLock.tryLock(0)) {
+        std::fprintf(stderr, "selaction is already running.\n");
+        return 1;
+    }
+
     QApplication app(argc, argv);
     QApplication::setQuitOnLastWindowClosed(false);
+    gStartupProfile.mark("qapplication");
 
     const AppSettings settings = loadSettings();
     gMinLogLevel = logLevelFromString(settings.logLevel);
     gPrevLogHandler = qInstallMessageHandler(logHandler);
+    gStartupProfile.mark("settings");
 
     qInfo() << "selaction started. Platform:" << QGuiApplication::platformName();
 
+    CommandServer commands;
+    if (!commands.listen(socketPath)) {
+        return 1;
+    }
+    gStartupProfile.mark("command_server");
+
     PopupController controller(settings);
+    gStartupProfile.mark("controller");
+    commands.setHandler([&controller](const QStringList &args) { return controller.handleCommand(args); });
+
+    QTimer::singleShot(0, &app, []() {
+        gStartupProfile.mark("event_loop");
+        gStartupProfile.report();
+    });
     return app.exec();
 }
 
@@ -0,0 +1,474 @@
+#include "selaction_text.h"
+
+#include <array>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// The Base64 kernels are compiled for their instruction set whatever the
+// build's baseline, and only run once the CPU is known to support it.
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define SELACTION_BASE64_SIMD 1
+#define SELACTION_TARGET(isa) __attribute__((target(isa)))
+#include <immintrin.h>
+#else
+#define SELACTION_BASE64_SIMD 0
+#endif
+
+namespace selaction::text {
+
+namespace {
+
+constexpr uchar kInvalid = 0xFF;
+
+constexpr char kBase64Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+constexpr char kHexDigits[] = "0123456789abcdef";
+constexpr char kUpperHexDigits[] = "0123456789ABCDEF";
+
+// Both the standard and the URL-safe alphabet decode; anything else is invalid.
+constexpr std::array<uchar, 256> makeBase64DecodeTable() {
+    std::array<uchar, 256> table{};
+    for (uchar &value : table) {
+        value = kInvalid;
+    }
+    for (int i = 0; i < 64; ++i) {
+        table[static_cast<uchar>(kBase64Alphabet[i])] = static_cast<uchar>(i);
+    }
+    table['-'] = 62;
+    table['_'] = 63;
+    return table;
+}
+
+constexpr std::array<uchar, 256> makeHexDecodeTable() {
+    std::array<uchar, 256> table{};
+    for (uchar &value : table) {
+        value = kInvalid;
+    }
+    for (int i = 0; i < 10; ++i) {
+        table['0' + i] = static_cast<uchar>(i);
+    }
+    for (int i = 0; i < 6; ++i) {
+        table['a' + i] = static_cast<uchar>(10 + i);
+        table['A' + i] = static_cast<uchar>(10 + i);
+    }
+    return table;
+}
+
+constexpr std::array<uchar, 256> kBase64DecodeTable = makeBase64DecodeTable();
+constexpr std::array<uchar, 256> kHexDecodeTable = makeHexDecodeTable();
+
+bool isAsciiSpace(char ch) {
+    return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r' || ch == '\f' || ch == '\v';
+}
+
+// Wrapped input (PEM bodies, hex dumps) is accepted by dropping ASCII
+// whitespace first; returns in itself when there is none.
+QByteArrayView withoutAsciiSpace(QByteArrayView in, QByteArray &storage) {
+    qsizetype i = 0;
+    while (i < in.size() && !isAsciiSpace(in[i])) {
+        ++i;
+    }
+    if (i == in.size()) {
+        return in;
+    }
+    storage.reserve(in.size());
+    storage.append(in.first(i));
+    for (; i < in.size(); ++i) {
+        if (!isAsciiSpace(in[i])) {
+            storage.append(in[i]);
+        }
+    }
+    return storage;
+}
+
+#if SELACTION_BASE64_SIMD
+// Encodes 12 bytes (of the 16 loaded) into 16 characters. Wojciech Muła's
+// multiply-shift unpacking followed by a pshufb alphabet lookup.
+SELACTION_TARGET("ssse3") __m128i base64EncodeBlock(__m128i in) {
+    in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+    const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+    const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    const __m128i indices = _mm_or_si128(t1, t3);
+
+    // 0..25 -> 13, 26..51 -> 0, 52..61 -> 1..10, 62 -> 11, 63 -> 12, then
+    // add the offset that range needs to reach its ASCII letter.
+    __m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    const __m128i upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+    range = _mm_or_si128(range, _mm_and_si128(upper, _mm_set1_epi8(13)));
+    const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                          '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    return _mm_add_epi8(_mm_shuffle_epi8(offsets, range), indices);
+}
+
+// Decodes 16 standard-alphabet characters into 12 bytes (stored as 16).
+// Returns false, writing nothing, if any character is outside the alphabet;
+// the scalar path then takes over and decides.
+SELACTION_TARGET("ssse3") bool base64DecodeBlock(__m128i in, char *out) {
+    const __m128i hi = _mm_and_si128(_mm_srli_epi32(in, 4), _mm_set1_epi8(0x0f));
+    const __m128i lo = _mm_and_si128(in, _mm_set1_epi8(0x0f));
+
+    // Bit h of maskLut[l] is set when character 0xhl is in the alphabet.
+    const __m128i maskLut = _mm_setr_epi8(
+        static_cast<char>(0xA8), static_cast<char>(0xF8), static_cast<char>(0xF8), static_cast<char>(0xF8),
+        static_cast<char>(0xF8), static_cast<char>(0xF8), static_cast<char>(0xF8), static_cast<char>(0xF8),
+        static_cast<char>(0xF8), static_cast<char>(0xF8), static_cast<char>(0xF0), 0x54, 0x50, 0x50, 0x50, 0x54);
+    const __m128i bitLut = _mm_setr_epi8(
+        0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, static_cast<char>(0x80), 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i valid = _mm_and_si128(_mm_shuffle_epi8(maskLut, lo), _mm_shuffle_epi8(bitLut, hi));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(valid, _mm_setzero_si128())) != 0) {
+        return false;
+    }
+
+    const __m128i shiftLut = _mm_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i isSlash = _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+    const __m128i shift = _mm_or_si128(_mm_andnot_si128(isSlash, _mm_shuffle_epi8(shiftLut, hi)),
+                                       _mm_and_si128(isSlash, _mm_set1_epi8(16)));
+    const __m128i values = _mm_add_epi8(in, shift);
+
+    // Pack four 6-bit values per 32-bit lane into 24 bits, then gather them.
+    const __m128i pairs = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+    const __m128i packed = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+    const __m128i bytes = _mm_shuffle_epi8(packed, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), bytes);
+    return true;
+}
+
+// The same two steps on 32 bytes. vpshufb only shuffles within a 128-bit
+// lane, so each lane holds one 12-byte group in the bytes the SSSE3 shuffle
+// reads.
+SELACTION_TARGET("avx2") __m256i base64EncodeBlock(__m256i in) {
+    in = _mm256_shuffle_epi8(in, _mm256_broadcastsi128_si256(
+                                     _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1)));
+    const __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+    const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+    const __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+    const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+    const __m256i indices = _mm256_or_si256(t1, t3);
+
+    __m256i range = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+    const __m256i upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+    range = _mm256_or_si256(range, _mm256_and_si256(upper, _mm256_set1_epi8(13)));
+    const __m256i offsets = _mm256_broadcastsi128_si256(
+        _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                      '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0));
+    return _mm256_add_epi8(_mm256_shuffle_epi8(offsets, range), indices);
+}
+
+// Decodes 32 standard-alphabet characters into 24 bytes (stored as 32), with
+// the SSSE3 lookups applied per lane.
+SELACTION_TARGET("avx2") bool base64DecodeBlock(__m256i in, char *out) {
+    const __m256i hi = _mm256_and_si256(_mm256_srli_epi32(in, 4), _mm256_set1_epi8(0x0f));
+    const __m256i lo = _mm256_and_si256(in, _mm256_set1_epi8(0x0f));
+
+    const __m256i maskLut = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+        static_cast<char>(0xA8), static_cast<char>(0xF8), static_cast<char>(0xF8), static_cast<char>(0xF8),
+        static_cast<char>(0xF8), static_cast<char>(0xF8), static_cast<char>(0xF8), static_cast<char>(0xF8),
+        static_cast<char>(0xF8), static_cast<char>(0xF8), static_cast<char>(0xF0), 0x54, 0x50, 0x50, 0x50, 0x54));
+    const __m256i bitLut = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+        0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, static_cast<char>(0x80), 0, 0, 0, 0, 0, 0, 0, 0));
+    const __m256i valid = _mm256_and_si256(_mm256_shuffle_epi8(maskLut, lo), _mm256_shuffle_epi8(bitLut, hi));
+    if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(valid, _mm256_setzero_si256())) != 0) {
+        return false;
+    }
+
+    const __m256i shiftLut =
+        _mm256_broadcastsi128_si256(_mm_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0));
+    const __m256i isSlash = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('/'));
+    const __m256i shift = _mm256_or_si256(_mm256_andnot_si256(isSlash, _mm256_shuffle_epi8(shiftLut, hi)),
+                                          _mm256_and_si256(isSlash, _mm256_set1_epi8(16)));
+    const __m256i values = _mm256_add_epi8(in, shift);
+
+    const __m256i pairs = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+    const __m256i packed = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000));
+    const __m256i lanes = _mm256_shuffle_epi8(
+        packed, _mm256_broadcastsi128_si256(_mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1)));
+    // Close the four-byte gap between the lanes' 12-byte results.
+    const __m256i bytes = _mm256_permutevar8x32_epi32(lanes, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), bytes);
+    return true;
+}
+
+// The vector loops return how much input they consumed: whole 12-byte groups
+// when encoding, whole 16-character blocks when decoding. Decoding stops at
+// the first block with a character outside the standard alphabet.
+SELACTION_TARGET("ssse3") qsizetype base64EncodeSsse3(const uchar *src, qsizetype n, char *dst) {
+    qsizetype i = 0;
+    // Each step consumes 12 bytes but loads 16.
+    for (; i + 16 <= n; i += 12, dst += 16) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), base64EncodeBlock(block));
+    }
+    return i;
+}
+
+SELACTION_TARGET("avx2") qsizetype base64EncodeAvx2(const uchar *src, qsizetype n, char *dst) {
+    qsizetype i = 0;
+    // Each step consumes 24 bytes, loading 16 from each 12-byte group.
+    for (; i + 28 <= n; i += 24, dst += 32) {
+        const __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        const __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 12));
+        const __m256i block = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), base64EncodeBlock(block));
+    }
+    return i + base64EncodeSsse3(src + i, n - i, dst);
+}
+
+SELACTION_TARGET("ssse3") qsizetype base64DecodeSsse3(const uchar *src, qsizetype n, char *dst) {
+    qsizetype i = 0;
+    for (; i + 16 <= n; i += 16, dst += 12) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        if (!base64DecodeBlock(block, dst)) {
+            break;
+        }
+    }
+    return i;
+}
+
+SELACTION_TARGET("avx2") qsizetype base64DecodeAvx2(const uchar *src, qsizetype n, char *dst) {
+    qsizetype i = 0;
+    for (; i + 32 <= n; i += 32, dst += 24) {
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        if (!base64DecodeBlock(block, dst)) {
+            break;
+        }
+    }
+    return i + base64DecodeSsse3(src + i, n - i, dst);
+}
+
+bool cpuSupports(Base64Kernel kernel) {
+    switch (kernel) {
+    case Base64Kernel::Scalar:
+        return true;
+    case Base64Kernel::Ssse3:
+        return __builtin_cpu_supports("ssse3");
+    case Base64Kernel::Avx2:
+        return __builtin_cpu_supports("avx2");
+    }
+    return false;
+}
+#else
+bool cpuSupports(Base64Kernel kernel) {
+    return kernel == Base64Kernel::Scalar;
+}
+#endif
+
+Base64Kernel bestBase64Kernel() {
+    static const Base64Kernel kernel = cpuSupports(Base64Kernel::Avx2)    ? Base64Kernel::Avx2
+                                       : cpuSupports(Base64Kernel::Ssse3) ? Base64Kernel::Ssse3
+                                                                          : Base64Kernel::Scalar;
+    return kernel;
+}
+
+#if defined(__SSE2__)
+// Nibble values 0..15 to lowercase hex digits.
+__m128i hexDigits(__m128i nibbles) {
+    const __m128i letters = _mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9));
+    return _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')), _mm_and_si128(letters, _mm_set1_epi8('a' - '0' - 10)));
+}
+#endif
+
+bool isUnreserved(uchar ch) {
+    return (ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z') || (ch >= '0' && ch <= '9')
+        || ch == '-' || ch == '.' || ch == '_' || ch == '~';
+}
+
+} // namespace
+
+QList<Base64Kernel> supportedBase64Kernels() {
+    QList<Base64Kernel> kernels;
+    for (const Base64Kernel kernel : {Base64Kernel::Scalar, Base64Kernel::Ssse3, Base64Kernel::Avx2}) {
+        if (cpuSupports(kernel)) {
+            kernels.append(kernel);
+        }
+    }
+    return kernels;
+}
+
+void base64Encode(QByteArrayView in, QByteArray &out) {
+    base64Encode(in, out, bestBase64Kernel());
+}
+
+void base64Encode(QByteArrayView in, QByteArray &out, Base64Kernel kernel) {
+    const qsizetype n = in.size();
+    out.resize((n + 2) / 3 * 4);
+    const uchar *src = reinterpret_cast<const uchar *>(in.data());
+    char *dst = out.data();
+    qsizetype i = 0;
+#if SELACTION_BASE64_SIMD
+    if (kernel == Base64Kernel::Avx2 && cpuSupports(kernel)) {
+        i = base64EncodeAvx2(src, n, dst);
+    } else if (kernel == Base64Kernel::Ssse3 && cpuSupports(kernel)) {
+        i = base64EncodeSsse3(src, n, dst);
+    }
+#else
+    Q_UNUSED(kernel);
+#endif
+    qsizetype o = i / 3 * 4;
+    for (; i + 3 <= n; i += 3, o += 4) {
+        const quint32 v = (quint32(src[i]) << 16) | (quint32(src[i + 1]) << 8) | src[i + 2];
+        dst[o] = kBase64Alphabet[(v >> 18) & 0x3F];
+        dst[o + 1] = kBase64Alphabet[(v >> 12) & 0x3F];
+        dst[o + 2] = kBase64Alphabet[(v >> 6) & 0x3F];
+        dst[o + 3] = kBase64Alphabet[v & 0x3F];
+    }
+    if (i < n) {
+        const bool two = i + 1 < n;
+        const quint32 v = (quint32(src[i]) << 16) | (two ? quint32(src[i + 1]) << 8 : 0);
+        dst[o] = kBase64Alphabet[(v >> 18) & 0x3F];
+        dst[o + 1] = kBase64Alphabet[(v >> 12) & 0x3F];
+        dst[o + 2] = two ? kBase64Alphabet[(v >> 6) & 0x3F] : '=';
+        dst[o + 3] = '=';
+    }
+}
+
+bool base64Decode(QByteArrayView in, QByteArray &out) {
+    return base64Decode(in, out, bestBase64Kernel());
+}
+
+bool base64Decode(QByteArrayView in, QByteArray &out, Base64Kernel kernel) {
+    QByteArray compact;
+    in = withoutAsciiSpace(in, compact);
+    qsizetype n = in.size();
+    int padding = 0;
+    while (n > 0 && padding < 2 && in[n - 1] == '=') {
+        --n;
+        ++padding;
+    }
+    // Padding is optional (JWT segments omit it), but when present it must
+    // complete the last quantum.
+    if ((padding > 0 && in.size() % 4 != 0) || n % 4 == 1) {
+        return false;
+    }
+
+    // The vector kernels store 32 bytes for the last 24 they decode.
+    out.resize(n / 4 * 3 + 8);
+    const uchar *src = reinterpret_cast<const uchar *>(in.data());
+    char *dst = out.data();
+    qsizetype i = 0;
+#if SELACTION_BASE64_SIMD
+    if (kernel == Base64Kernel::Avx2 && cpuSupports(kernel)) {
+        i = base64DecodeAvx2(src, n, dst);
+    } else if (kernel == Base64Kernel::Ssse3 && cpuSupports(kernel)) {
+        i = base64DecodeSsse3(src, n, dst);
+    }
+#else
+    Q_UNUSED(kernel);
+#endif
+    qsizetype o = i / 4 * 3;
+    for (; i + 4 <= n; i += 4, o += 3) {
+        const uchar a = kBase64DecodeTable[src[i]];
+        const uchar b = kBase64DecodeTable[src[i + 1]];
+        const uchar c = kBase64DecodeTable[src[i + 2]];
+        const uchar d = kBase64DecodeTable[src[i + 3]];
+        if (((a | b | c | d) & 0xC0) != 0) {
+            return false;
+        }
+        const quint32 v = (quint32(a) << 18) | (quint32(b) << 12) | (quint32(c) << 6) | d;
+        dst[o] = static_cast<char>(v >> 16);
+        dst[o + 1] = static_cast<char>(v >> 8);
+        dst[o + 2] = static_cast<char>(v);
+    }
+    if (i < n) {
+        const uchar a = kBase64DecodeTable[src[i]];
+        const uchar b = kBase64DecodeTable[src[i + 1]];
+        const uchar c = n - i == 3 ? kBase64DecodeTable[src[i + 2]] : 0;
+        if (((a | b | c) & 0xC0) != 0) {
+            return false;
+        }
+        // Bits past the last whole byte must be zero, so every byte string
+        // has exactly one accepted encoding.
+        if (n - i == 2 ? (b & 0x0F) != 0 : (c & 0x03) != 0) {
+            return false;
+        }
+        dst[o++] = static_cast<char>((a << 2) | (b >> 4));
+        if (n - i == 3) {
+            dst[o++] = static_cast<char>((b << 4) | (c >> 2));
+        }
+    }
+    out.resize(o);
+    return true;
+}
+
+void hexEncode(QByteArrayView in, QByteArray &out) {
+    const qsizetype n = in.size();
+    out.resize(n * 2);
+    const uchar *src = reinterpret_cast<const uchar *>(in.data());
+    char *dst = out.data();
+    qsizetype i = 0;
+#if defined(__SSE2__)
+    const __m128i lowNibble = _mm_set1_epi8(0x0F);
+    for (; i + 16 <= n; i += 16) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        const __m128i hi = hexDigits(_mm_and_si128(_mm_srli_epi16(block, 4), lowNibble));
+        const __m128i lo = hexDigits(_mm_and_si128(block, lowNibble));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 2 * i), _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 2 * i + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[2 * i] = kHexDigits[src[i] >> 4];
+        dst[2 * i + 1] = kHexDigits[src[i] & 0x0F];
+    }
+}
+
+bool hexDecode(QByteArrayView in, QByteArray &out) {
+    QByteArray compact;
+    in = withoutAsciiSpace(in, compact);
+    if (in.size() % 2 != 0) {
+        return false;
+    }
+    out.resize(in.size() / 2);
+    const uchar *src = reinterpret_cast<const uchar *>(in.data());
+    char *dst = out.data();
+    for (qsizetype i = 0; i < out.size(); ++i) {
+        const uchar hi = kHexDecodeTable[src[2 * i]];
+        const uchar lo = kHexDecodeTable[src[2 * i + 1]];
+        if (hi == kInvalid || lo == kInvalid) {
+            return false;
+        }
+        dst[i] = static_cast<char>((hi << 4) | lo);
+    }
+    return true;
+}
+
+void percentEncode(QByteArrayView in, QByteArray &out) {
+    out.resize(0);
+    out.reserve(in.size() + in.size() / 2);
+    for (const char ch : in) {
+        const uchar byte = static_cast<uchar>(ch);
+        if (isUnreserved(byte)) {
+            out.append(ch);
+        } else {
+            const char escaped[3] = {'%', kUpperHexDigits[byte >> 4], kUpperHexDigits[byte & 0x0F]};
+            out.append(escaped, 3);
+        }
+    }
+}
+
+bool percentDecode(QByteArrayView in, QByteArray &out) {
+    out.resize(0);
+    out.reserve(in.size());
+    const qsizetype n = in.size();
+    for (qsizetype i = 0; i < n; ++i) {
+        if (in[i] != '%') {
+            out.append(in[i]);
+            continue;
+        }
+        if (i + 2 >= n) {
+            return false;
+        }
+        const uchar hi = kHexDecodeTable[static_cast<uchar>(in[i + 1])];
+        const uchar lo = kHexDecodeTable[static_cast<uchar>(in[i + 2])];
+        if (hi == kInvalid || lo == kInvalid) {
+            return false;
+        }
+        out.append(static_cast<char>((hi << 4) | lo));
+        i += 2;
+    }
+    return true;
+}
+
+} // namespace selaction::text
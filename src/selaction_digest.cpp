@@ -0,0 +1,161 @@
+#include "selaction_digest.h"
+
+#include <QCryptographicHash>
+
+#include <array>
+#include <optional>
+
+#define XXH_INLINE_ALL
+#include "xxhash.h"
+
+namespace selaction::text {
+
+namespace {
+
+// Reflected CRC-32 (zlib/PNG polynomial), slicing-by-8.
+class Crc32Hasher {
+public:
+    void addData(QByteArrayView data) {
+        const auto &tables = this->tables();
+        const uchar *p = reinterpret_cast<const uchar *>(data.data());
+        qsizetype n = data.size();
+        quint32 crc = crc_;
+        for (; n >= 8; p += 8, n -= 8) {
+            const quint32 lo = crc ^ (quint32(p[0]) | quint32(p[1]) << 8 | quint32(p[2]) << 16 | quint32(p[3]) << 24);
+            const quint32 hi = quint32(p[4]) | quint32(p[5]) << 8 | quint32(p[6]) << 16 | quint32(p[7]) << 24;
+            crc = tables[7][lo & 0xFF] ^ tables[6][(lo >> 8) & 0xFF] ^ tables[5][(lo >> 16) & 0xFF] ^ tables[4][lo >> 24]
+                ^ tables[3][hi & 0xFF] ^ tables[2][(hi >> 8) & 0xFF] ^ tables[1][(hi >> 16) & 0xFF] ^ tables[0][hi >> 24];
+        }
+        for (; n > 0; ++p, --n) {
+            crc = tables[0][(crc ^ *p) & 0xFF] ^ (crc >> 8);
+        }
+        crc_ = crc;
+    }
+
+    quint32 result() const {
+        return ~crc_;
+    }
+
+private:
+    using Tables = std::array<std::array<quint32, 256>, 8>;
+
+    static const Tables &tables() {
+        static const Tables tables = []() {
+            Tables t{};
+            for (quint32 i = 0; i < 256; ++i) {
+                quint32 c = i;
+                for (int k = 0; k < 8; ++k) {
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                }
+                t[0][i] = c;
+            }
+            for (quint32 i = 0; i < 256; ++i) {
+                for (int k = 1; k < 8; ++k) {
+                    t[k][i] = t[0][t[k - 1][i] & 0xFF] ^ (t[k - 1][i] >> 8);
+                }
+            }
+            return t;
+        }();
+        return tables;
+    }
+
+    quint32 crc_ = 0xFFFFFFFFu;
+};
+
+QByteArray bigEndianHex(quint64 value, int bytes) {
+    QByteArray raw(bytes, Qt::Uninitialized);
+    for (int i = bytes - 1; i >= 0; --i) {
+        raw[i] = static_cast<char>(value & 0xFF);
+        value >>= 8;
+    }
+    return raw.toHex();
+}
+
+} // namespace
+
+struct MultiHasher::State {
+    std::optional<QCryptographicHash> sha256;
+    std::optional<QCryptographicHash> sha1;
+    std::optional<QCryptographicHash> md5;
+    std::optional<Crc32Hasher> crc32;
+    XXH3_state_t *xxh3 = nullptr;
+};
+
+MultiHasher::MultiHasher(quint32 digests)
+    : d_(std::make_unique<State>()) {
+    if (digests & Sha256) {
+        d_->sha256.emplace(QCryptographicHash::Sha256);
+    }
+    if (digests & Sha1) {
+        d_->sha1.emplace(QCryptographicHash::Sha1);
+    }
+    if (digests & Md5) {
+        d_->md5.emplace(QCryptographicHash::Md5);
+    }
+    if (digests & Crc32) {
+        d_->crc32.emplace();
+    }
+    if (digests & Xxh3) {
+        // Heap allocated by xxHash; on failure XXH3 is left out of results().
+        d_->xxh3 = XXH3_createState();
+        if (d_->xxh3 && XXH3_64bits_reset(d_->xxh3) != XXH_OK) {
+            XXH3_freeState(d_->xxh3);
+            d_->xxh3 = nullptr;
+        }
+    }
+}
+
+MultiHasher::~MultiHasher() {
+    if (d_->xxh3) {
+        XXH3_freeState(d_->xxh3);
+    }
+}
+
+void MultiHasher::addData(QByteArrayView data) {
+    if (d_->sha256) {
+        d_->sha256->addData(data);
+    }
+    if (d_->sha1) {
+        d_->sha1->addData(data);
+    }
+    if (d_->md5) {
+        d_->md5->addData(data);
+    }
+    if (d_->crc32) {
+        d_->crc32->addData(data);
+    }
+    if (d_->xxh3) {
+        XXH3_64bits_update(d_->xxh3, data.data(), static_cast<size_t>(data.size()));
+    }
+}
+
+QList<DigestResult> MultiHasher::results() {
+    QList<DigestResult> results;
+    if (d_->sha256) {
+        results.append({QStringLiteral("SHA-256"), d_->sha256->result().toHex()});
+    }
+    if (d_->sha1) {
+        results.append({QStringLiteral("SHA-1"), d_->sha1->result().toHex()});
+    }
+    if (d_->md5) {
+        results.append({QStringLiteral("MD5"), d_->md5->result().toHex()});
+    }
+    if (d_->crc32) {
+        results.append({QStringLiteral("CRC32"), bigEndianHex(d_->crc32->result(), 4)});
+    }
+    if (d_->xxh3) {
+        results.append({QStringLiteral("XXH3"), bigEndianHex(XXH3_64bits_digest(d_->xxh3), 8)});
+    }
+    return results;
+}
+
+QList<DigestResult> digest(QByteArrayView data, quint32 digests) {
+    constexpr qsizetype kChunkBytes = 64 * 1024;
+    MultiHasher hasher(digests);
+    for (qsizetype offset = 0; offset < data.size(); offset += kChunkBytes) {
+        hasher.addData(data.sliced(offset, qMin(kChunkBytes, data.size() - offset)));
+    }
+    return hasher.results();
+}
+
+} // namespace selaction::text
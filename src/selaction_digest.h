@@ -0,0 +1,51 @@
+#pragma once
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QList>
+#include <QString>
+
+#include <memory>
+
+// Digests of selected text. Every selected algorithm is fed the same chunk
+// in turn while it is still in cache, so any number of digests costs one pass
+// over the input.
+namespace selaction::text {
+
+enum Digest : quint32 {
+    Sha256 = 0x01,
+    Sha1 = 0x02,
+    Md5 = 0x04,
+    Crc32 = 0x08,
+    Xxh3 = 0x10,
+    AllDigests = Sha256 | Sha1 | Md5 | Crc32 | Xxh3,
+};
+
+struct DigestResult {
+    QString name;
+    // Lowercase hex; CRC32 and XXH3 in big-endian (canonical) byte order.
+    QByteArray hex;
+};
+
+class MultiHasher {
+public:
+    explicit MultiHasher(quint32 digests);
+    ~MultiHasher();
+    MultiHasher(const MultiHasher &) = delete;
+    MultiHasher &operator=(const MultiHasher &) = delete;
+
+    void addData(QByteArrayView data);
+    // In the order of the Digest enum. Call once, after the last addData().
+    // A digest whose state could not be allocated is missing, so callers
+    // must not assume one result per requested digest.
+    QList<DigestResult> results();
+
+private:
+    struct State;
+    std::unique_ptr<State> d_;
+};
+
+// Streams data through a MultiHasher in cache-sized chunks.
+QList<DigestResult> digest(QByteArrayView data, quint32 digests);
+
+} // namespace selaction::text
@@ -0,0 +1,805 @@
+#include "selaction_history.h"
+
+#include <QDateTime>
+#include <QDebug>
+
+#include <algorithm>
+#include <array>
+#include <iterator>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace selaction::text {
+
+namespace {
+
+// Gear table for content-defined chunking, derived with splitmix64 so chunk
+// boundaries are identical across runs.
+const std::array<quint64, 256> &gearTable() {
+    static const std::array<quint64, 256> table = []() {
+        std::array<quint64, 256> values{};
+        quint64 state = 0x9E3779B97F4A7C15ULL;
+        for (quint64 &value : values) {
+            state += 0x9E3779B97F4A7C15ULL;
+            quint64 z = state;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            value = z ^ (z >> 31);
+        }
+        return values;
+    }();
+    return table;
+}
+
+// Approximate heap cost of the list node, the index entry and the chunk
+// table entry; the chunk fingerprint list is charged per element.
+constexpr qsizetype kEntryOverhead = 128;
+constexpr qsizetype kChunkOverhead = 64;
+
+qsizetype entryOverhead(const ClipboardHistory::Entry &entry) {
+    return kEntryOverhead + entry.chunks.size() * qsizetype(sizeof(quint64));
+}
+
+// Next slot probed when a chunk key is taken by different bytes.
+quint64 nextProbe(quint64 key) {
+    return (key ^ (key >> 31)) * 0x9E3779B97F4A7C15ULL + 1;
+}
+
+constexpr qsizetype kIndexedBytes = 64 * 1024;
+// Substring terms score at least kFuzzyMaxScore + 1, fuzzy terms at most
+// kFuzzyMaxScore, so any substring match of a term beats a fuzzy one.
+constexpr int kFuzzyMaxScore = 99;
+constexpr int kSubstringScore = 1000;
+constexpr qsizetype kMaxPositionPenalty = 900;
+constexpr int kWordStartBonus = 200;
+// Set in a posting's offset when a word starts there.
+constexpr quint32 kStartsWordFlag = quint32(1) << 31;
+// Slots left by removed or reused entries are reclaimed once they are half
+// the list.
+constexpr qsizetype kMinCompactSlots = 1024;
+
+char asciiLower(char ch) {
+    return (ch >= 'A' && ch <= 'Z') ? char(ch - 'A' + 'a') : ch;
+}
+
+char asciiUpper(char ch) {
+    return (ch >= 'a' && ch <= 'z') ? char(ch - 'a' + 'A') : ch;
+}
+
+bool matchesAtCaseInsensitive(QByteArrayView haystack, qsizetype pos, QByteArrayView needle) {
+    for (qsizetype i = 0; i < needle.size(); ++i) {
+        if (asciiLower(haystack[pos + i]) != needle[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// ASCII case-insensitive search for a lowercase needle. Candidate positions for
+// the first byte are found 16 bytes at a time with SSE2 where available.
+qsizetype findCaseInsensitive(QByteArrayView haystack, QByteArrayView needle) {
+    if (needle.isEmpty()) {
+        return 0;
+    }
+    if (needle.size() > haystack.size()) {
+        return -1;
+    }
+    const char first = needle[0];
+    const char firstUpper = asciiUpper(first);
+    const qsizetype last = haystack.size() - needle.size();
+    qsizetype i = 0;
+#if defined(__SSE2__)
+    const __m128i lower = _mm_set1_epi8(first);
+    const __m128i upper = _mm_set1_epi8(firstUpper);
+    for (; i + 16 <= last + 1; i += 16) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(haystack.data() + i));
+        quint32 mask = quint32(_mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(block, lower), _mm_cmpeq_epi8(block, upper))));
+        while (mask) {
+            const qsizetype pos = i + qCountTrailingZeroBits(mask);
+            if (matchesAtCaseInsensitive(haystack, pos, needle)) {
+                return pos;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; i <= last; ++i) {
+        const char ch = haystack[i];
+        if ((ch == first || ch == firstUpper) && matchesAtCaseInsensitive(haystack, i, needle)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+quint32 pairKey(QByteArrayView bytes, qsizetype i) {
+    return (quint32(1) << 24) | (quint32(uchar(asciiLower(bytes[i]))) << 8)
+           | quint32(uchar(asciiLower(bytes[i + 1])));
+}
+
+quint32 tripleKey(QByteArrayView bytes, qsizetype i) {
+    return (quint32(uchar(asciiLower(bytes[i]))) << 16) | (quint32(uchar(asciiLower(bytes[i + 1]))) << 8)
+           | quint32(uchar(asciiLower(bytes[i + 2])));
+}
+
+// Whether a word starts at byte pos of UTF-8 text, judged by the whole
+// code point before it rather than its last byte.
+bool startsWord(QByteArrayView text, qsizetype pos) {
+    if (pos == 0) {
+        return true;
+    }
+    const uchar previous = uchar(text[pos - 1]);
+    if (previous < 0x80) {
+        return !QChar::isLetterOrNumber(char32_t(previous));
+    }
+    qsizetype start = pos - 1;
+    while (start > 0 && pos - start < 4 && (uchar(text[start]) & 0xC0) == 0x80) {
+        --start;
+    }
+    const QList<uint> codePoints = QString::fromUtf8(text.sliced(start, pos - start)).toUcs4();
+    return codePoints.isEmpty() || !QChar::isLetterOrNumber(char32_t(codePoints.last()));
+}
+
+// Lowercased byte pairs and triples as keys of one table, each with where it
+// first occurs; pairs have bit 24 set, which no triple has.
+QHash<quint32, quint32> ngramsOf(QByteArrayView bytes) {
+    QHash<quint32, quint32> first;
+    const auto note = [&](quint32 key, qsizetype pos) {
+        if (!first.contains(key)) {
+            first.insert(key, quint32(pos) | (startsWord(bytes, pos) ? kStartsWordFlag : 0));
+        }
+    };
+    for (qsizetype i = 0; i + 1 < bytes.size(); ++i) {
+        note(pairKey(bytes, i), i);
+        if (i + 2 < bytes.size()) {
+            note(tripleKey(bytes, i), i);
+        }
+    }
+    return first;
+}
+
+// Keys a term of two or more bytes is looked up by: its pair, or its triples.
+QSet<quint32> termKeys(QByteArrayView term) {
+    QSet<quint32> keys;
+    if (term.size() == 2) {
+        keys.insert(pairKey(term, 0));
+    }
+    for (qsizetype i = 0; i + 2 < term.size(); ++i) {
+        keys.insert(tripleKey(term, i));
+    }
+    return keys;
+}
+
+int termScore(qsizetype pos, bool wordStart) {
+    return kSubstringScore - int(qMin(pos, kMaxPositionPenalty)) + (wordStart ? kWordStartBonus : 0);
+}
+
+// Sum of per-term scores when every term is a substring of the entry,
+// otherwise 0.
+int substringScore(QByteArrayView text, const QList<QByteArray> &terms) {
+    int score = 0;
+    for (const QByteArray &term : terms) {
+        const qsizetype pos = findCaseInsensitive(text, term);
+        if (pos < 0) {
+            return 0;
+        }
+        score += termScore(pos, startsWord(text, pos));
+    }
+    return score;
+}
+
+// Scores a lowercase term as a subsequence of text, ASCII case folded: the
+// first full match is found scanning forward, then the tightest window ending
+// there is found scanning back. Shorter windows and a window starting a word
+// score higher.
+int fuzzyScore(QByteArrayView text, QByteArrayView term) {
+    qsizetype t = 0;
+    qsizetype end = -1;
+    for (qsizetype i = 0; i < text.size(); ++i) {
+        if (asciiLower(text[i]) == term[t] && ++t == term.size()) {
+            end = i;
+            break;
+        }
+    }
+    if (end < 0) {
+        return 0;
+    }
+    qsizetype start = end;
+    t = term.size() - 1;
+    for (qsizetype i = end; i >= 0; --i) {
+        if (asciiLower(text[i]) == term[t] && --t < 0) {
+            start = i;
+            break;
+        }
+    }
+    const qsizetype window = end - start + 1;
+    const int score = 1 + int(79 * term.size() / window) + (startsWord(text, start) ? 19 : 0);
+    return qMin(score, kFuzzyMaxScore);
+}
+
+void addToMask(quint64 (&mask)[2], QByteArrayView bytes) {
+    for (const char ch : bytes) {
+        const uchar bit = uchar(asciiLower(ch)) & 0x7F;
+        mask[bit >> 6] |= quint64(1) << (bit & 63);
+    }
+}
+
+} // namespace
+
+quint64 textFingerprint(QByteArrayView bytes) {
+    quint64 hash = 14695981039346656037ULL;
+    for (const char ch : bytes) {
+        hash ^= static_cast<unsigned char>(ch);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+QList<ChunkSpan> contentDefinedChunks(QByteArrayView bytes) {
+    constexpr qsizetype kMinChunk = 512;
+    constexpr qsizetype kMaxChunk = 8192;
+    constexpr quint64 kBoundaryMask = (1ULL << 11) - 1;
+
+    const std::array<quint64, 256> &gear = gearTable();
+    QList<ChunkSpan> spans;
+    qsizetype start = 0;
+    while (start < bytes.size()) {
+        const qsizetype remaining = bytes.size() - start;
+        qsizetype length = qMin(remaining, kMaxChunk);
+        if (remaining > kMinChunk) {
+            quint64 hash = 0;
+            for (qsizetype i = kMinChunk; i < length; ++i) {
+                hash = (hash << 1) + gear[static_cast<unsigned char>(bytes[start + i])];
+                if ((hash & kBoundaryMask) == 0) {
+                    length = i + 1;
+                    break;
+                }
+            }
+        }
+        spans.append({start, length});
+        start += length;
+    }
+    return spans;
+}
+
+ClipboardHistory::ClipboardHistory(ChunkHash chunkHash)
+    : chunkHash_(chunkHash) {}
+
+void ClipboardHistory::setByteBudget(qsizetype bytes) {
+    budget_ = qMax<qsizetype>(0, bytes);
+    if (chargedBytes() > budget_) {
+        while (chargedBytes() > budget_ && !entries_.empty()) {
+            remove(std::prev(entries_.end()));
+        }
+        compact();
+    }
+}
+
+ClipboardHistory::Stats ClipboardHistory::stats() const {
+    Stats stats;
+    stats.entries = index_.size();
+    stats.chunks = chunks_.size() - tombstones_;
+    stats.logicalBytes = logicalBytes_;
+    stats.storedBytes = storedBytes_;
+    stats.overheadBytes = overheadBytes_;
+    stats.arenaBytes = arena_.size();
+    return stats;
+}
+
+quint64 ClipboardHistory::add(const QString &text) {
+    return add(text.toUtf8());
+}
+
+quint64 ClipboardHistory::add(const QByteArray &utf8, qint64 timestampMs, quint64 fingerprint) {
+    if (budget_ <= 0 || utf8.isEmpty()) {
+        return 0;
+    }
+    if (timestampMs <= 0) {
+        timestampMs = QDateTime::currentMSecsSinceEpoch();
+    }
+    if (utf8.size() + kEntryOverhead + kChunkOverhead > budget_) {
+        qDebug() << "History: entry exceeds budget len=" << utf8.size();
+        return 0;
+    }
+
+    if (fingerprint == 0) {
+        fingerprint = textFingerprint(utf8);
+    }
+    const auto found = index_.constFind(fingerprint);
+    if (found != index_.constEnd()) {
+        const auto it = found.value();
+        if (bytes(*it) == utf8) {
+            it->timestampMs = timestampMs;
+            entries_.splice(entries_.begin(), entries_, it);
+            if (onAdded_) {
+                onAdded_(fingerprint, utf8);
+            }
+            return fingerprint;
+        }
+        remove(it);
+    }
+
+    // Pin chunks we already hold so the eviction below cannot drop them.
+    const QList<ChunkSpan> spans = contentDefinedChunks(utf8);
+    const auto pieceAt = [&](qsizetype i) {
+        return QByteArrayView(utf8.constData() + spans[i].offset, spans[i].length);
+    };
+    QList<quint64> chunkKeys(spans.size(), 0);
+    QList<bool> pinned(spans.size(), false);
+    QMultiHash<quint64, qsizetype> missing;
+    // Bookkeeping is charged too, so many small entries cannot exceed the budget.
+    qsizetype newBytes = kEntryOverhead + spans.size() * qsizetype(sizeof(quint64));
+    for (qsizetype i = 0; i < spans.size(); ++i) {
+        const QByteArrayView piece = pieceAt(i);
+        const quint64 hash = chunkHash_(piece);
+        const quint64 key = resolveChunkKey(piece, hash);
+        const auto chunk = chunks_.find(key);
+        if (chunk != chunks_.end() && chunk->refs > 0) {
+            chunk->refs++;
+            chunkKeys[i] = key;
+            pinned[i] = true;
+            continue;
+        }
+        bool planned = false;
+        for (auto it = missing.constFind(hash); it != missing.constEnd() && it.key() == hash; ++it) {
+            if (pieceAt(it.value()) == piece) {
+                planned = true;
+                break;
+            }
+        }
+        if (!planned) {
+            missing.insert(hash, i);
+            newBytes += spans[i].length + kChunkOverhead;
+        }
+    }
+
+    while (chargedBytes() + newBytes > budget_ && !entries_.empty()) {
+        remove(std::prev(entries_.end()));
+    }
+    // Freed spans are reclaimed once they make up a quarter of the budget,
+    // so a full ring does not repack the whole arena on every add.
+    if (arena_.size() - storedBytes_ > budget_ / 4) {
+        compact();
+    }
+
+    // Unpinned keys are resolved only now: eviction may have freed a slot,
+    // and an earlier span of this text may have stored the same bytes.
+    for (qsizetype i = 0; i < spans.size(); ++i) {
+        if (pinned[i]) {
+            continue;
+        }
+        const QByteArrayView piece = pieceAt(i);
+        const quint64 key = resolveChunkKey(piece, chunkHash_(piece));
+        chunkKeys[i] = key;
+        const auto chunk = chunks_.find(key);
+        if (chunk != chunks_.end() && chunk->refs > 0) {
+            chunk->refs++;
+            continue;
+        }
+        if (chunk != chunks_.end()) {
+            --tombstones_;
+        }
+        Chunk stored;
+        stored.offset = arena_.size();
+        stored.length = piece.size();
+        stored.refs = 1;
+        arena_.append(piece);
+        storedBytes_ += stored.length;
+        overheadBytes_ += kChunkOverhead;
+        chunks_.insert(key, stored);
+    }
+
+    Entry entry;
+    entry.fingerprint = fingerprint;
+    entry.length = utf8.size();
+    entry.chunks = chunkKeys;
+    entry.timestampMs = timestampMs;
+    logicalBytes_ += entry.length;
+    overheadBytes_ += entryOverhead(entry);
+    entries_.push_front(entry);
+    index_.insert(fingerprint, entries_.begin());
+    qDebug() << "History: entries=" << index_.size() << "logical=" << logicalBytes_
+             << "stored=" << storedBytes_ << "chunks=" << chunks_.size() - tombstones_;
+    if (onAdded_) {
+        onAdded_(fingerprint, utf8);
+    }
+    return fingerprint;
+}
+
+QString ClipboardHistory::text(quint64 fingerprint) const {
+    const auto found = index_.constFind(fingerprint);
+    if (found == index_.constEnd()) {
+        return QString();
+    }
+    return QString::fromUtf8(bytes(*found.value()));
+}
+
+QByteArray ClipboardHistory::utf8(quint64 fingerprint) const {
+    const auto found = index_.constFind(fingerprint);
+    return found == index_.constEnd() ? QByteArray() : bytes(*found.value());
+}
+
+QByteArrayView ClipboardHistory::view(quint64 fingerprint, QByteArray &scratch) const {
+    const auto found = index_.constFind(fingerprint);
+    if (found == index_.constEnd()) {
+        return QByteArrayView();
+    }
+    const Entry &entry = *found.value();
+    if (entry.chunks.size() == 1) {
+        const auto chunk = chunks_.constFind(entry.chunks.first());
+        return chunk == chunks_.constEnd() ? QByteArrayView() : chunkBytes(chunk.value());
+    }
+    scratch = bytes(entry);
+    return scratch;
+}
+
+qint64 ClipboardHistory::timestamp(quint64 fingerprint) const {
+    const auto found = index_.constFind(fingerprint);
+    return found == index_.constEnd() ? 0 : found.value()->timestampMs;
+}
+
+QList<quint64> ClipboardHistory::recent(int count) const {
+    QList<quint64> result;
+    for (const Entry &entry : entries_) {
+        if (result.size() >= count) {
+            break;
+        }
+        result.append(entry.fingerprint);
+    }
+    return result;
+}
+
+// Key under which piece is or would be stored. A hash match is only trusted
+// after comparing the bytes; on a collision the key is remixed and probed
+// again, so colliding chunks get distinct slots. Probing continues past
+// tombstones, and the first one is reused when the bytes are not stored.
+quint64 ClipboardHistory::resolveChunkKey(QByteArrayView piece, quint64 hash) const {
+    quint64 key = hash;
+    quint64 reusable = 0;
+    bool haveReusable = false;
+    for (;;) {
+        const auto chunk = chunks_.constFind(key);
+        if (chunk == chunks_.constEnd()) {
+            return haveReusable ? reusable : key;
+        }
+        if (chunk->refs == 0) {
+            if (!haveReusable) {
+                reusable = key;
+                haveReusable = true;
+            }
+        } else if (chunkBytes(chunk.value()) == piece) {
+            return key;
+        }
+        key = nextProbe(key);
+    }
+}
+
+QByteArray ClipboardHistory::bytes(const Entry &entry) const {
+    QByteArray out;
+    out.reserve(entry.length);
+    for (const quint64 chunkKey : entry.chunks) {
+        out.append(chunkBytes(chunks_.value(chunkKey)));
+    }
+    return out;
+}
+
+void ClipboardHistory::remove(EntryIterator it) {
+    for (const quint64 chunkKey : it->chunks) {
+        const auto chunk = chunks_.find(chunkKey);
+        if (chunk == chunks_.end() || chunk->refs == 0) {
+            continue;
+        }
+        if (--chunk->refs == 0) {
+            storedBytes_ -= chunk->length;
+            overheadBytes_ -= kChunkOverhead;
+            // A chunk stored further along this probe chain must stay
+            // reachable, so the slot becomes a tombstone instead.
+            if (chunks_.contains(nextProbe(chunkKey))) {
+                chunk->length = 0;
+                ++tombstones_;
+            } else {
+                chunks_.erase(chunk);
+            }
+        }
+    }
+    logicalBytes_ -= it->length;
+    overheadBytes_ -= entryOverhead(*it);
+    const quint64 fingerprint = it->fingerprint;
+    index_.remove(fingerprint);
+    entries_.erase(it);
+    if (onRemoved_) {
+        onRemoved_(fingerprint);
+    }
+}
+
+void ClipboardHistory::compact() {
+    // Tombstones that end a probe chain guard nothing; dropping one can end
+    // the chain earlier, so repeat until none is left at an end.
+    for (bool dropped = tombstones_ > 0; dropped;) {
+        dropped = false;
+        for (auto it = chunks_.begin(); it != chunks_.end();) {
+            if (it->refs == 0 && !chunks_.contains(nextProbe(it.key()))) {
+                it = chunks_.erase(it);
+                --tombstones_;
+                dropped = true;
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    QByteArray packed;
+    packed.reserve(storedBytes_);
+    for (Chunk &chunk : chunks_) {
+        const qsizetype offset = packed.size();
+        packed.append(arena_.constData() + chunk.offset, chunk.length);
+        chunk.offset = offset;
+    }
+    arena_ = std::move(packed);
+}
+
+void HistorySearchIndex::add(quint64 fingerprint, QByteArrayView utf8) {
+    const auto found = slots_.constFind(fingerprint);
+    if (found != slots_.constEnd()) {
+        if (found.value() == quint32(entries_.size() - 1)) {
+            return;
+        }
+        // Reused: indexed again in a new slot at the end.
+        entries_[found.value()].fingerprint = 0;
+        ++freeSlots_;
+    }
+    const quint32 slot = quint32(entries_.size());
+    const QHash<quint32, quint32> ngrams = ngramsOf(utf8.first(qMin(utf8.size(), kIndexedBytes)));
+    for (auto it = ngrams.constBegin(); it != ngrams.constEnd(); ++it) {
+        postings_[it.key()].append({slot, it.value()});
+    }
+    Entry entry;
+    entry.fingerprint = fingerprint;
+    if (utf8.size() > kIndexedBytes) {
+        longEntries_.insert(fingerprint);
+        entry.chars[0] = entry.chars[1] = ~quint64(0);
+    } else {
+        addToMask(entry.chars, utf8);
+    }
+    slots_.insert(fingerprint, slot);
+    entries_.append(entry);
+    compact();
+}
+
+void HistorySearchIndex::remove(quint64 fingerprint) {
+    const auto found = slots_.constFind(fingerprint);
+    if (found == slots_.constEnd()) {
+        return;
+    }
+    entries_[found.value()].fingerprint = 0;
+    ++freeSlots_;
+    slots_.erase(found);
+    longEntries_.remove(fingerprint);
+    compact();
+}
+
+// Drops freed slots and renumbers the rest, in one pass over the postings.
+void HistorySearchIndex::compact() {
+    if (freeSlots_ < kMinCompactSlots || freeSlots_ * 2 < entries_.size()) {
+        return;
+    }
+    constexpr quint32 kFreed = ~quint32(0);
+    QList<quint32> moved(entries_.size(), kFreed);
+    quint32 live = 0;
+    for (qsizetype i = 0; i < entries_.size(); ++i) {
+        if (entries_[i].fingerprint != 0) {
+            moved[i] = live;
+            entries_[live++] = entries_[i];
+        }
+    }
+    entries_.resize(live);
+    for (auto it = postings_.begin(); it != postings_.end();) {
+        Posting &posting = it.value();
+        qsizetype kept = 0;
+        for (qsizetype i = 0; i < posting.size(); ++i) {
+            const quint32 slot = moved[posting[i].slot];
+            if (slot != kFreed) {
+                posting[kept++] = {slot, posting[i].first};
+            }
+        }
+        if (kept == 0) {
+            it = postings_.erase(it);
+        } else {
+            posting.resize(kept);
+            ++it;
+        }
+    }
+    for (quint32 slot = 0; slot < live; ++slot) {
+        slots_.insert(entries_[slot].fingerprint, slot);
+    }
+    freeSlots_ = 0;
+}
+
+QList<HistorySearchIndex::Match> HistorySearchIndex::search(const QString &query, int limit,
+                                                            const ClipboardHistory &history,
+                                                            SearchStats *stats) const {
+    QList<QByteArray> terms;
+    quint64 needed[2] = {0, 0};
+    for (const QByteArray &term : query.toUtf8().toLower().split(' ')) {
+        if (!term.isEmpty()) {
+            terms.append(term);
+            addToMask(needed, term);
+        }
+    }
+    QList<Match> matches;
+    if (terms.isEmpty() || limit <= 0) {
+        return matches;
+    }
+    const auto mayMatch = [&needed](const Entry &entry) {
+        return entry.fingerprint != 0 && (entry.chars[0] & needed[0]) == needed[0]
+               && (entry.chars[1] & needed[1]) == needed[1];
+    };
+
+    // A term of two or three bytes is a single key, and its posting already
+    // holds where the term first occurs. Longer terms are narrowed by their
+    // triples and one-byte terms by the character sets; both are then found
+    // in the entry's text.
+    struct Filter {
+        const Posting *posting = nullptr;
+        bool exact = false;
+    };
+    QList<Filter> filters;
+    QList<QByteArray> scanned;
+    bool indexed = false;
+    bool missingKey = false;
+    for (const QByteArray &term : terms) {
+        if (term.size() < 2 || term.size() > 3) {
+            scanned.append(term);
+        }
+        if (term.size() < 2) {
+            continue;
+        }
+        indexed = true;
+        for (const quint32 key : termKeys(term)) {
+            const auto posting = postings_.constFind(key);
+            if (posting == postings_.constEnd()) {
+                missingKey = true;
+                break;
+            }
+            filters.append({&posting.value(), term.size() <= 3});
+        }
+    }
+
+    // Candidates are visited most recently used first. Ties go to the more
+    // recent entry, so once limit entries reach the best possible score no
+    // older one can displace them.
+    struct Ranked {
+        quint64 fingerprint = 0;
+        int score = 0;
+        quint32 slot = 0;
+    };
+    QList<Ranked> ranked;
+    const int bestScore = int(terms.size()) * (kSubstringScore + kWordStartBonus);
+    int atBest = 0;
+    int visited = 0;
+    QByteArray scratch;
+    const auto scoreText = [&](quint64 fingerprint, const QList<QByteArray> &wanted) {
+        const QByteArrayView text = history.view(fingerprint, scratch);
+        return text.isEmpty() ? 0 : substringScore(text, wanted);
+    };
+    if (indexed) {
+        // Entries past the indexed prefix may hold the terms further on.
+        for (const quint64 fingerprint : longEntries_) {
+            ++visited;
+            const int score = scoreText(fingerprint, terms);
+            if (score > 0) {
+                ranked.append({fingerprint, score, slots_.value(fingerprint)});
+            }
+        }
+        if (!missingKey) {
+            std::sort(filters.begin(), filters.end(),
+                      [](const Filter &a, const Filter &b) { return a.posting->size() < b.posting->size(); });
+            const Posting &smallest = *filters.first().posting;
+            const auto findHit = [](const Posting &posting, quint32 slot) -> const Hit * {
+                const auto it = std::lower_bound(posting.begin(), posting.end(), slot,
+                                                 [](const Hit &hit, quint32 wanted) { return hit.slot < wanted; });
+                return it != posting.end() && it->slot == slot ? &*it : nullptr;
+            };
+            for (qsizetype i = smallest.size() - 1; i >= 0; --i) {
+                const Hit &hit = smallest[i];
+                const quint64 fingerprint = entries_[hit.slot].fingerprint;
+                if (fingerprint == 0 || (!longEntries_.isEmpty() && longEntries_.contains(fingerprint))) {
+                    continue;
+                }
+                int score = 0;
+                bool all = true;
+                for (const Filter &filter : filters) {
+                    const Hit *found = filter.posting == &smallest ? &hit : findHit(*filter.posting, hit.slot);
+                    if (!found) {
+                        all = false;
+                        break;
+                    }
+                    if (filter.exact) {
+                        score += termScore(found->first & ~kStartsWordFlag, (found->first & kStartsWordFlag) != 0);
+                    }
+                }
+                if (!all) {
+                    continue;
+                }
+                ++visited;
+                if (!scanned.isEmpty()) {
+                    const int rest = scoreText(fingerprint, scanned);
+                    if (rest <= 0) {
+                        continue;
+                    }
+                    score += rest;
+                }
+                ranked.append({fingerprint, score, hit.slot});
+                if (score == bestScore && ++atBest >= limit) {
+                    break;
+                }
+            }
+        }
+    } else {
+        for (qsizetype i = entries_.size() - 1; i >= 0; --i) {
+            if (!mayMatch(entries_[i])) {
+                continue;
+            }
+            ++visited;
+            const int score = scoreText(entries_[i].fingerprint, terms);
+            if (score <= 0) {
+                continue;
+            }
+            ranked.append({entries_[i].fingerprint, score, quint32(i)});
+            if (score == bestScore && ++atBest >= limit) {
+                break;
+            }
+        }
+    }
+
+    // Remaining places go to fuzzy matches, most recent first.
+    int fuzzyScanned = 0;
+    if (ranked.size() < limit) {
+        QSet<quint64> matched;
+        for (const Ranked &match : ranked) {
+            matched.insert(match.fingerprint);
+        }
+        for (qsizetype i = entries_.size() - 1; i >= 0 && ranked.size() < limit; --i) {
+            if (!mayMatch(entries_[i]) || matched.contains(entries_[i].fingerprint)) {
+                continue;
+            }
+            const QByteArrayView text = history.view(entries_[i].fingerprint, scratch);
+            ++fuzzyScanned;
+            int score = 0;
+            for (const QByteArray &term : terms) {
+                const int termScore = fuzzyScore(text, term);
+                if (termScore <= 0) {
+                    score = 0;
+                    break;
+                }
+                score += termScore;
+            }
+            if (score > 0) {
+                ranked.append({entries_[i].fingerprint, score, quint32(i)});
+            }
+        }
+    }
+    if (stats) {
+        stats->candidates = visited;
+        stats->fuzzyScanned = fuzzyScanned;
+    }
+
+    // Only the top limit are ordered; a one-letter query can match everything.
+    const qsizetype kept = qMin<qsizetype>(limit, ranked.size());
+    std::partial_sort(ranked.begin(), ranked.begin() + kept, ranked.end(), [](const Ranked &a, const Ranked &b) {
+        if (a.score != b.score) {
+            return a.score > b.score;
+        }
+        return a.slot > b.slot;
+    });
+    matches.reserve(kept);
+    for (qsizetype i = 0; i < kept; ++i) {
+        matches.append({ranked[i].fingerprint, ranked[i].score, history.timestamp(ranked[i].fingerprint)});
+    }
+    return matches;
+}
+
+} // namespace selaction::text
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QHash>
+#include <QList>
+#include <QSet>
+#include <QString>
+
+#include <functional>
+#include <list>
+
+// Clipboard history kept in memory: a chunk-deduplicated store under a byte
+// budget and a trigram search index over it. Only QtCore is required.
+namespace selaction::text {
+
+// FNV-1a over the UTF-8 bytes; stable across runs so it can be persisted.
+quint64 textFingerprint(QByteArrayView bytes);
+
+struct ChunkSpan {
+    qsizetype offset = 0;
+    qsizetype length = 0;
+};
+
+// Splits bytes at content-defined boundaries using a gear rolling hash, so an
+// edit only changes the chunks around it. Chunks are 512 bytes to 8 KiB, about
+// 2 KiB on average.
+QList<ChunkSpan> contentDefinedChunks(QByteArrayView bytes);
+
+// Recently seen texts, split into content-defined chunks that are stored once
+// in a single arena, so near-duplicate entries share most of their bytes. The
+// arena never holds more than the byte budget; entries are keyed by
+// fingerprint and evicted least recently used first.
+class ClipboardHistory {
+public:
+    using ChunkHash = quint64 (*)(QByteArrayView bytes);
+
+    struct Entry {
+        quint64 fingerprint = 0;
+        qsizetype length = 0;
+        QList<quint64> chunks;
+        qint64 timestampMs = 0;
+    };
+
+    struct Stats {
+        int entries = 0;
+        int chunks = 0;
+        qsizetype logicalBytes = 0;
+        qsizetype storedBytes = 0;
+        qsizetype overheadBytes = 0;
+        qsizetype arenaBytes = 0;
+
+        qsizetype chargedBytes() const {
+            return storedBytes + overheadBytes;
+        }
+
+        double dedupRatio() const {
+            return storedBytes > 0 ? double(logicalBytes) / double(storedBytes) : 1.0;
+        }
+    };
+
+    // chunkHash keys the chunk store. Matches are always confirmed by
+    // comparing bytes, so any function works; tests pass a colliding one.
+    explicit ClipboardHistory(ChunkHash chunkHash = textFingerprint);
+
+    void setByteBudget(qsizetype bytes);
+
+    qsizetype byteBudget() const {
+        return budget_;
+    }
+
+    int size() const {
+        return index_.size();
+    }
+
+    Stats stats() const;
+
+    // Called when an entry is stored, and again when the same text is added
+    // later and the entry moves to the front.
+    void setOnAdded(std::function<void(quint64, QByteArrayView)> handler) {
+        onAdded_ = std::move(handler);
+    }
+
+    void setOnRemoved(std::function<void(quint64)> handler) {
+        onRemoved_ = std::move(handler);
+    }
+
+    // Returns the fingerprint of the stored text, or 0 if it was not stored.
+    quint64 add(const QString &text);
+    quint64 add(const QByteArray &utf8, qint64 timestampMs = 0, quint64 fingerprint = 0);
+
+    QString text(quint64 fingerprint) const;
+    QByteArray utf8(quint64 fingerprint) const;
+    // The entry's bytes, without a copy when it is a single chunk; otherwise
+    // they are assembled in scratch. Valid until the history is next changed.
+    QByteArrayView view(quint64 fingerprint, QByteArray &scratch) const;
+    qint64 timestamp(quint64 fingerprint) const;
+
+    bool contains(quint64 fingerprint) const {
+        return index_.contains(fingerprint);
+    }
+
+    // Most recently used first.
+    QList<quint64> recent(int count) const;
+
+private:
+    // refs == 0 marks a tombstone: a freed slot that later chunks were probed
+    // past, kept so lookups still reach them.
+    struct Chunk {
+        qsizetype offset = 0;
+        qsizetype length = 0;
+        int refs = 0;
+    };
+
+    using EntryIterator = std::list<Entry>::iterator;
+
+    qsizetype chargedBytes() const {
+        return storedBytes_ + overheadBytes_;
+    }
+
+    QByteArrayView chunkBytes(const Chunk &chunk) const {
+        return QByteArrayView(arena_.constData() + chunk.offset, chunk.length);
+    }
+
+    quint64 resolveChunkKey(QByteArrayView piece, quint64 hash) const;
+    QByteArray bytes(const Entry &entry) const;
+    void remove(EntryIterator it);
+    void compact();
+
+    ChunkHash chunkHash_;
+    std::list<Entry> entries_;
+    QHash<quint64, EntryIterator> index_;
+    QHash<quint64, Chunk> chunks_;
+    std::function<void(quint64, QByteArrayView)> onAdded_;
+    std::function<void(quint64)> onRemoved_;
+    QByteArray arena_;
+    qsizetype logicalBytes_ = 0;
+    qsizetype storedBytes_ = 0;
+    qsizetype overheadBytes_ = 0;
+    qsizetype budget_ = 0;
+    int tombstones_ = 0;
+};
+
+// Search over history entries, kept in sync as entries are added, reused and
+// evicted. Terms of two or more bytes are looked up in an index of the byte
+// pairs and triples in the first 64 KiB of each entry; one-byte terms are
+// prefiltered by the set of characters each entry contains. Matches are
+// verified against the history's own chunk-backed bytes, so the index holds no
+// copy of the text.
+class HistorySearchIndex {
+public:
+    struct Match {
+        quint64 fingerprint = 0;
+        int score = 0;
+        qint64 timestampMs = 0;
+    };
+
+    struct SearchStats {
+        int candidates = 0;
+        int fuzzyScanned = 0;
+    };
+
+    // Indexes a new entry, or marks an indexed one as the most recently used.
+    void add(quint64 fingerprint, QByteArrayView utf8);
+    void remove(quint64 fingerprint);
+
+    int size() const {
+        return slots_.size();
+    }
+
+    // Every whitespace-separated term must occur in the entry (ASCII case
+    // folded). Matches at the start of the entry or of a word rank higher, ties
+    // go to the more recently used entry. When fewer than limit entries contain
+    // the terms, the remaining places go to fuzzy subsequence matches, taken
+    // from the most recently used entries first; those always rank below
+    // substring matches.
+    QList<Match> search(const QString &query, int limit, const ClipboardHistory &history,
+                        SearchStats *stats = nullptr) const;
+
+private:
+    // chars is the set of ASCII-folded bytes the entry contains. Bytes from
+    // 0x80 share the bit of their low seven bits, which only adds false
+    // positives; entries longer than the indexed prefix have every bit set.
+    // A zero fingerprint marks the slot of a removed or reused entry.
+    struct Entry {
+        quint64 fingerprint = 0;
+        quint64 chars[2] = {0, 0};
+    };
+
+    // An entry's slot and where the key first occurs in it, with the top bit
+    // set when a word starts there. Postings are sorted by slot and may still
+    // name freed slots until the next compaction.
+    struct Hit {
+        quint32 slot = 0;
+        quint32 first = 0;
+    };
+    using Posting = QList<Hit>;
+
+    void compact();
+
+    QHash<quint32, Posting> postings_;
+    // Least recently used first: a reused entry moves to a new slot at the
+    // end, so a search walks slots backwards and can stop once nothing older
+    // could rank higher.
+    QList<Entry> entries_;
+    QHash<quint64, quint32> slots_;
+    QSet<quint64> longEntries_;
+    qsizetype freeSlots_ = 0;
+};
+
+} // namespace selaction::text
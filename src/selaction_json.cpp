@@ -0,0 +1,509 @@
+#include "selaction_json.h"
+
+#include <QtAlgorithms>
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace selaction::text {
+
+namespace {
+
+bool isDigit(char ch) {
+    return ch >= '0' && ch <= '9';
+}
+
+bool isHexDigit(char ch) {
+    return isDigit(ch) || (ch >= 'a' && ch <= 'f') || (ch >= 'A' && ch <= 'F');
+}
+
+// Sort order of a raw key: its bytes, with escapes decoded so "\u0041" sorts
+// as "A". UTF-8 byte order equals code point order, so an escaped surrogate
+// pair is combined into its code point first.
+QByteArray sortKeyOf(QByteArrayView raw) {
+    const QByteArrayView body = raw.sliced(1, raw.size() - 2);
+    if (!body.contains('\\')) {
+        return body.toByteArray();
+    }
+    QByteArray key;
+    key.reserve(body.size());
+    for (qsizetype i = 0; i < body.size(); ++i) {
+        if (body[i] != '\\') {
+            key.append(body[i]);
+            continue;
+        }
+        const char escape = body[++i];
+        switch (escape) {
+        case 'b': key.append('\b'); break;
+        case 'f': key.append('\f'); break;
+        case 'n': key.append('\n'); break;
+        case 'r': key.append('\r'); break;
+        case 't': key.append('\t'); break;
+        case 'u': {
+            QString units(QChar(static_cast<char16_t>(body.sliced(i + 1, 4).toUShort(nullptr, 16))));
+            i += 4;
+            if (units.front().isHighSurrogate() && i + 6 < body.size() && body[i + 1] == '\\'
+                && body[i + 2] == 'u') {
+                const QChar low(static_cast<char16_t>(body.sliced(i + 3, 4).toUShort(nullptr, 16)));
+                if (low.isLowSurrogate()) {
+                    units.append(low);
+                    i += 6;
+                }
+            }
+            key.append(units.toUtf8());
+            break;
+        }
+        default: key.append(escape); break;
+        }
+    }
+    return key;
+}
+
+class JsonReformatter {
+public:
+    JsonReformatter(QByteArrayView in, QByteArray &out, const JsonFormatOptions &options)
+        : in_(in), out_(out), options_(options) {}
+
+    JsonError run() {
+        out_.resize(0);
+        out_.reserve(options_.pretty ? in_.size() + in_.size() / 2 : in_.size());
+        const qsizetype n = in_.size();
+        qsizetype i = 0;
+        Expect expect = Expect::Value;
+        while (error_.ok()) {
+            i = skipWhitespace(i);
+            if (expect == Expect::Done) {
+                if (i < n) {
+                    fail(i, "Unexpected data after the JSON value");
+                }
+                break;
+            }
+            if (i >= n) {
+                fail(i, "Unexpected end of input");
+                break;
+            }
+            const char ch = in_[i];
+            switch (expect) {
+            case Expect::ValueOrEnd:
+                if (ch == ']') {
+                    ++i;
+                    expect = close();
+                    break;
+                }
+                Q_FALLTHROUGH();
+            case Expect::Value:
+                beginElement();
+                if (ch == '{' || ch == '[') {
+                    open(ch);
+                    ++i;
+                    expect = ch == '{' ? Expect::KeyOrEnd : Expect::ValueOrEnd;
+                } else {
+                    const qsizetype end = scanScalar(i);
+                    if (end < 0) {
+                        break;
+                    }
+                    sink().append(in_.sliced(i, end - i));
+                    i = end;
+                    expect = afterValue();
+                }
+                break;
+            case Expect::KeyOrEnd:
+                if (ch == '}') {
+                    ++i;
+                    expect = close();
+                    break;
+                }
+                Q_FALLTHROUGH();
+            case Expect::Key: {
+                if (ch != '"') {
+                    fail(i, "Expected an object key");
+                    break;
+                }
+                const qsizetype end = scanString(i);
+                if (end < 0) {
+                    break;
+                }
+                beginElement();
+                writeKey(in_.sliced(i, end - i));
+                i = skipWhitespace(end);
+                if (i >= n || in_[i] != ':') {
+                    fail(i, "Expected ':' after an object key");
+                    break;
+                }
+                ++i;
+                expect = Expect::Value;
+                break;
+            }
+            case Expect::CommaOrEnd: {
+                const char closing = frames_.back().close;
+                if (ch == ',') {
+                    ++i;
+                    expect = closing == '}' ? Expect::Key : Expect::Value;
+                } else if (ch == closing) {
+                    ++i;
+                    expect = close();
+                } else {
+                    fail(i, closing == '}' ? "Expected ',' or '}'" : "Expected ',' or ']'");
+                }
+                break;
+            }
+            case Expect::Done:
+                break;
+            }
+        }
+        return error_;
+    }
+
+private:
+    enum class Expect { Value, ValueOrEnd, Key, KeyOrEnd, CommaOrEnd, Done };
+
+    // Text inside sorted objects is written once to scratch_ and described by
+    // pieces: a span of scratch_, or a whole nested sorted object (a node).
+    // Closing an object only reorders its members' piece lists, and the
+    // outermost one is copied to out_ in a single walk, so nested objects are
+    // not copied again at every level.
+    struct Piece {
+        qsizetype offset = 0;
+        qsizetype length = 0;
+        qsizetype node = -1;
+    };
+
+    struct Member {
+        QByteArray key;
+        std::vector<Piece> pieces;
+        // Start of the member's scratch_ text not yet recorded as a piece.
+        qsizetype spanStart = 0;
+    };
+
+    struct Frame {
+        char close = ']';
+        bool empty = true;
+        // Sorted objects collect their members and order them on close.
+        bool sorted = false;
+        std::vector<Member> members;
+    };
+
+    void fail(qsizetype offset, const char *message) {
+        if (error_.ok()) {
+            error_.offset = offset;
+            error_.message = QString::fromLatin1(message);
+        }
+    }
+
+    qsizetype skipWhitespace(qsizetype i) const {
+        while (i < in_.size()) {
+            const char ch = in_[i];
+            if (ch != ' ' && ch != '\n' && ch != '\r' && ch != '\t') {
+                break;
+            }
+            ++i;
+        }
+        return i;
+    }
+
+    // Inside a sorted object output goes to scratch_, as part of the
+    // innermost sorted object's current member.
+    QByteArray &sink() {
+        return sortedFrames_.empty() ? out_ : scratch_;
+    }
+
+    void newline(qsizetype depth) {
+        appendNewline(sink(), depth);
+    }
+
+    void appendNewline(QByteArray &target, qsizetype depth) {
+        if (!options_.pretty) {
+            return;
+        }
+        const qsizetype width = depth * options_.indent;
+        if (indentation_.size() < width) {
+            indentation_.fill(' ', width * 2);
+        }
+        target.append('\n');
+        target.append(QByteArrayView(indentation_.constData(), width));
+    }
+
+    // Records the member's scratch_ text written since the last piece.
+    void flushSpan(Member &member) {
+        if (scratch_.size() > member.spanStart) {
+            member.pieces.push_back({member.spanStart, scratch_.size() - member.spanStart});
+        }
+        member.spanStart = scratch_.size();
+    }
+
+    void appendSpan(std::vector<Piece> &pieces, QByteArrayView text) {
+        pieces.push_back({scratch_.size(), text.size()});
+        scratch_.append(text);
+    }
+
+    // Copies a finished outermost sorted object to out_; iterative, because
+    // sorted objects nest as deep as the input does.
+    void emitNode(qsizetype root) {
+        std::vector<std::pair<qsizetype, size_t>> stack{{root, 0}};
+        while (!stack.empty()) {
+            const qsizetype node = stack.back().first;
+            const size_t position = stack.back().second++;
+            if (position == nodes_[node].size()) {
+                stack.pop_back();
+                continue;
+            }
+            const Piece piece = nodes_[node][position];
+            if (piece.node >= 0) {
+                stack.push_back({piece.node, 0});
+            } else {
+                out_.append(scratch_.constData() + piece.offset, piece.length);
+            }
+        }
+    }
+
+    // Separator and indentation before an array value or an object key.
+    void beginElement() {
+        if (frames_.empty()) {
+            return;
+        }
+        Frame &top = frames_.back();
+        if (top.sorted) {
+            if (!inMemberValue_) {
+                if (!top.empty) {
+                    flushSpan(top.members.back());
+                }
+                top.members.push_back({});
+                top.members.back().spanStart = scratch_.size();
+            }
+        } else if (!inMemberValue_) {
+            if (!top.empty) {
+                sink().append(',');
+            }
+            newline(qsizetype(frames_.size()));
+        }
+        top.empty = false;
+        inMemberValue_ = false;
+    }
+
+    void writeKey(QByteArrayView raw) {
+        Frame &top = frames_.back();
+        if (top.sorted) {
+            top.members.back().key = sortKeyOf(raw);
+        }
+        QByteArray &target = sink();
+        target.append(raw);
+        target.append(options_.pretty ? ": " : ":");
+        // The value that follows belongs to this key, not a new element.
+        inMemberValue_ = true;
+    }
+
+    void open(char ch) {
+        Frame frame;
+        frame.close = ch == '{' ? '}' : ']';
+        frame.sorted = ch == '{' && options_.sortKeys;
+        if (!frame.sorted) {
+            sink().append(ch);
+        } else if (!sortedFrames_.empty()) {
+            // The enclosing member's text so far precedes this object.
+            flushSpan(frames_[sortedFrames_.back()].members.back());
+        }
+        frames_.push_back(std::move(frame));
+        if (frames_.back().sorted) {
+            sortedFrames_.push_back(frames_.size() - 1);
+        }
+    }
+
+    Expect close() {
+        Frame top = std::move(frames_.back());
+        frames_.pop_back();
+        const qsizetype depth = qsizetype(frames_.size());
+        if (top.sorted) {
+            sortedFrames_.pop_back();
+            if (!top.empty) {
+                flushSpan(top.members.back());
+            }
+            std::stable_sort(top.members.begin(), top.members.end(),
+                             [](const Member &a, const Member &b) { return a.key < b.key; });
+            std::vector<Piece> node;
+            appendSpan(node, "{");
+            QByteArray separator;
+            for (size_t k = 0; k < top.members.size(); ++k) {
+                separator.resize(0);
+                if (k > 0) {
+                    separator.append(',');
+                }
+                appendNewline(separator, depth + 1);
+                appendSpan(node, separator);
+                node.insert(node.end(), top.members[k].pieces.begin(), top.members[k].pieces.end());
+            }
+            separator.resize(0);
+            if (!top.empty) {
+                appendNewline(separator, depth);
+            }
+            separator.append('}');
+            appendSpan(node, separator);
+            nodes_.push_back(std::move(node));
+            const qsizetype index = qsizetype(nodes_.size()) - 1;
+            if (sortedFrames_.empty()) {
+                emitNode(index);
+                scratch_.resize(0);
+                nodes_.clear();
+            } else {
+                Member &enclosing = frames_[sortedFrames_.back()].members.back();
+                enclosing.pieces.push_back({0, 0, index});
+                enclosing.spanStart = scratch_.size();
+            }
+            return afterValue();
+        }
+        if (!top.empty) {
+            newline(depth);
+        }
+        sink().append(top.close);
+        return afterValue();
+    }
+
+    Expect afterValue() {
+        inMemberValue_ = false;
+        return frames_.empty() ? Expect::Done : Expect::CommaOrEnd;
+    }
+
+    qsizetype scanScalar(qsizetype i) {
+        const char ch = in_[i];
+        if (ch == '"') {
+            return scanString(i);
+        }
+        if (ch == '-' || isDigit(ch)) {
+            return scanNumber(i);
+        }
+        for (const char *literal : {"true", "false", "null"}) {
+            if (in_.sliced(i).startsWith(literal)) {
+                return i + qsizetype(qstrlen(literal));
+            }
+        }
+        fail(i, "Unexpected character");
+        return -1;
+    }
+
+    // Index past the closing quote of the string at in_[i] == '"', or -1.
+    qsizetype scanString(qsizetype i) {
+        const qsizetype n = in_.size();
+        const char *data = in_.data();
+        qsizetype j = i + 1;
+        for (;;) {
+#if defined(__SSE2__)
+            // Skip 16 bytes at a time until a quote, backslash or control byte.
+            const __m128i quote = _mm_set1_epi8('"');
+            const __m128i backslash = _mm_set1_epi8('\\');
+            const __m128i controlMax = _mm_set1_epi8(0x1F);
+            while (j + 16 <= n) {
+                const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + j));
+                const __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(block, controlMax), block);
+                const __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, quote), _mm_cmpeq_epi8(block, backslash)), control);
+                const int mask = _mm_movemask_epi8(special);
+                if (mask != 0) {
+                    j += qCountTrailingZeroBits(static_cast<quint32>(mask));
+                    break;
+                }
+                j += 16;
+            }
+#endif
+            if (j >= n) {
+                fail(i, "Unterminated string");
+                return -1;
+            }
+            const char ch = data[j];
+            if (ch == '"') {
+                return j + 1;
+            }
+            if (ch == '\\') {
+                if (j + 1 >= n) {
+                    fail(i, "Unterminated string");
+                    return -1;
+                }
+                const char escape = data[j + 1];
+                if (escape == 'u') {
+                    for (qsizetype k = j + 2; k < j + 6; ++k) {
+                        if (k >= n || !isHexDigit(data[k])) {
+                            fail(j, "Invalid \\u escape");
+                            return -1;
+                        }
+                    }
+                    j += 6;
+                } else if (escape != '\0' && std::strchr("\"\\/bfnrt", escape)) {
+                    j += 2;
+                } else {
+                    fail(j, "Invalid escape sequence");
+                    return -1;
+                }
+                continue;
+            }
+            if (static_cast<uchar>(ch) < 0x20) {
+                fail(j, "Control character in string");
+                return -1;
+            }
+            ++j;
+        }
+    }
+
+    qsizetype scanNumber(qsizetype i) {
+        const qsizetype n = in_.size();
+        qsizetype j = i;
+        if (in_[j] == '-') {
+            ++j;
+        }
+        if (j < n && in_[j] == '0') {
+            ++j;
+        } else if (j < n && isDigit(in_[j])) {
+            while (j < n && isDigit(in_[j])) {
+                ++j;
+            }
+        } else {
+            fail(j, "Invalid number");
+            return -1;
+        }
+        if (j < n && in_[j] == '.') {
+            ++j;
+            if (j >= n || !isDigit(in_[j])) {
+                fail(j, "Invalid number");
+                return -1;
+            }
+            while (j < n && isDigit(in_[j])) {
+                ++j;
+            }
+        }
+        if (j < n && (in_[j] == 'e' || in_[j] == 'E')) {
+            ++j;
+            if (j < n && (in_[j] == '+' || in_[j] == '-')) {
+                ++j;
+            }
+            if (j >= n || !isDigit(in_[j])) {
+                fail(j, "Invalid number");
+                return -1;
+            }
+            while (j < n && isDigit(in_[j])) {
+                ++j;
+            }
+        }
+        return j;
+    }
+
+    QByteArrayView in_;
+    QByteArray &out_;
+    JsonFormatOptions options_;
+    JsonError error_;
+    std::vector<Frame> frames_;
+    std::vector<size_t> sortedFrames_;
+    QByteArray scratch_;
+    std::vector<std::vector<Piece>> nodes_;
+    bool inMemberValue_ = false;
+    QByteArray indentation_;
+};
+
+} // namespace
+
+JsonError reformatJson(QByteArrayView in, QByteArray &out, const JsonFormatOptions &options) {
+    return JsonReformatter(in, out, options).run();
+}
+
+} // namespace selaction::text
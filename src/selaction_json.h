@@ -0,0 +1,33 @@
+#pragma once
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QString>
+
+// Single-pass JSON reformatting. The input is tokenized and validated as it
+// is copied, with no document tree; scalars are copied verbatim. Extra memory
+// is one small frame per open container, except that sortKeys has to hold each
+// object's members until the object closes.
+namespace selaction::text {
+
+struct JsonFormatOptions {
+    bool pretty = true;
+    int indent = 2;
+    bool sortKeys = false;
+};
+
+struct JsonError {
+    // Byte offset of the first invalid input, or -1 when the input was valid.
+    qsizetype offset = -1;
+    QString message;
+
+    bool ok() const {
+        return offset < 0;
+    }
+};
+
+// Writes the reformatted UTF-8 JSON to out, replacing its contents. On error
+// out holds the output produced so far.
+JsonError reformatJson(QByteArrayView in, QByteArray &out, const JsonFormatOptions &options);
+
+} // namespace selaction::text
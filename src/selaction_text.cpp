@@ -0,0 +1,308 @@
+#include "selaction_text.h"
+
+#include <QStringList>
+
+namespace selaction::text {
+
+namespace {
+
+void assign(QStringView in, QString &out) {
+    out.resize(0);
+    out.append(in);
+}
+
+} // namespace
+
+void copy(QStringView in, QString &out) {
+    assign(in, out);
+}
+
+void toUpper(QStringView in, QString &out) {
+    assign(in, out);
+    // The rvalue overload converts in place when the buffer is not shared.
+    out = std::move(out).toUpper();
+}
+
+void toLower(QStringView in, QString &out) {
+    assign(in, out);
+    out = std::move(out).toLower();
+}
+
+void normalizeWhitespace(QStringView in, QString &out) {
+    out.resize(0);
+    out.reserve(in.size());
+    bool pendingSpace = false;
+    for (const QChar ch : in) {
+        if (ch.isSpace()) {
+            pendingSpace = !out.isEmpty();
+            continue;
+        }
+        if (pendingSpace) {
+            out.append(u' ');
+            pendingSpace = false;
+        }
+        out.append(ch);
+    }
+}
+
+void toTitleCase(QStringView in, QString &out) {
+    normalizeWhitespace(in, out);
+    out = std::move(out).toLower();
+    bool wordStart = true;
+    for (qsizetype i = 0; i < out.size(); ++i) {
+        const QChar ch = out.at(i);
+        if (ch == u' ') {
+            wordStart = true;
+            continue;
+        }
+        if (!wordStart) {
+            continue;
+        }
+        wordStart = false;
+        if (ch.isHighSurrogate() && i + 1 < out.size() && out.at(i + 1).isLowSurrogate()) {
+            const char32_t upper = QChar::toUpper(QChar::surrogateToUcs4(ch, out.at(i + 1)));
+            if (QChar::requiresSurrogates(upper)) {
+                out[i] = QChar(QChar::highSurrogate(upper));
+                out[i + 1] = QChar(QChar::lowSurrogate(upper));
+            }
+            ++i;
+        } else {
+            out[i] = ch.toUpper();
+        }
+    }
+}
+
+namespace {
+
+// Output side of htmlToPlainText: collapses whitespace the way a browser
+// would and defers separators until the next visible character, so nothing
+// leads or trails the result.
+class PlainTextWriter {
+public:
+    explicit PlainTextWriter(QString &out)
+        : out_(out) {}
+
+    void character(char32_t ch, bool preformatted) {
+        const bool space = ch == U' ' || ch == U'\t' || ch == U'\n' || ch == U'\r' || ch == U'\f';
+        if (space && !preformatted) {
+            if (separator_ == 0) {
+                separator_ = u' ';
+            }
+            return;
+        }
+        flush();
+        if (ch == U'\r') {
+            return;
+        }
+        if (QChar::requiresSurrogates(ch)) {
+            out_.append(QChar(QChar::highSurrogate(ch)));
+            out_.append(QChar(QChar::lowSurrogate(ch)));
+        } else {
+            out_.append(QChar(static_cast<char16_t>(ch)));
+        }
+    }
+
+    void block(int newlines) {
+        newlines_ = qMax(newlines_, newlines);
+    }
+
+    void lineBreak() {
+        newlines_ = qMin(newlines_ + 1, 2);
+    }
+
+    void cell() {
+        if (newlines_ == 0) {
+            separator_ = u'\t';
+        }
+    }
+
+private:
+    void flush() {
+        if (!out_.isEmpty()) {
+            if (newlines_ > 0) {
+                out_.append(QString(newlines_, u'\n'));
+            } else if (separator_ != 0) {
+                out_.append(QChar(separator_));
+            }
+        }
+        newlines_ = 0;
+        separator_ = 0;
+    }
+
+    QString &out_;
+    int newlines_ = 0;
+    char16_t separator_ = 0;
+};
+
+bool isTagNameChar(QChar ch) {
+    return ch.isLetterOrNumber() || ch == u'-' || ch == u':';
+}
+
+// Decodes the entity at in[i] == '&'. Returns the code point and advances i
+// past it; unknown or malformed entities return 0 and leave i alone.
+char32_t decodeEntity(QStringView in, qsizetype &i) {
+    constexpr qsizetype kMaxEntityLength = 32;
+    const qsizetype semicolon = in.mid(i + 1, kMaxEntityLength).indexOf(u';');
+    if (semicolon <= 0) {
+        return 0;
+    }
+    const QStringView name = in.mid(i + 1, semicolon);
+    char32_t ch = 0;
+    if (name.startsWith(u'#')) {
+        bool ok = false;
+        const bool hex = name.size() > 1 && (name[1] == u'x' || name[1] == u'X');
+        const uint value = name.mid(hex ? 2 : 1).toUInt(&ok, hex ? 16 : 10);
+        if (!ok || value == 0 || value > 0x10FFFF || (value >= 0xD800 && value <= 0xDFFF)) {
+            return 0;
+        }
+        ch = value;
+    } else {
+        static const struct {
+            const char16_t *name;
+            char32_t ch;
+        } kNamed[] = {
+            {u"amp", U'&'}, {u"lt", U'<'}, {u"gt", U'>'}, {u"quot", U'"'}, {u"apos", U'\''},
+            {u"nbsp", 0x00A0}, {u"copy", 0x00A9}, {u"reg", 0x00AE}, {u"trade", 0x2122},
+            {u"hellip", 0x2026}, {u"mdash", 0x2014}, {u"ndash", 0x2013}, {u"lsquo", 0x2018},
+            {u"rsquo", 0x2019}, {u"ldquo", 0x201C}, {u"rdquo", 0x201D}, {u"laquo", 0x00AB},
+            {u"raquo", 0x00BB}, {u"bull", 0x2022}, {u"middot", 0x00B7}, {u"times", 0x00D7},
+            {u"euro", 0x20AC}, {u"deg", 0x00B0},
+        };
+        for (const auto &entity : kNamed) {
+            if (name == QStringView(entity.name)) {
+                ch = entity.ch;
+                break;
+            }
+        }
+        if (ch == 0) {
+            return 0;
+        }
+    }
+    i += semicolon + 2;
+    return ch;
+}
+
+} // namespace
+
+void htmlToPlainText(QStringView html, QString &out) {
+    static const QStringList kParagraphTags = {
+        "p", "h1", "h2", "h3", "h4", "h5", "h6", "blockquote", "pre", "table", "ul", "ol", "dl",
+    };
+    static const QStringList kBlockTags = {
+        "address", "article", "aside", "dd", "div", "dt", "fieldset", "figcaption", "figure", "footer",
+        "form", "header", "hr", "li", "main", "nav", "section", "tr", "caption",
+    };
+    static const QStringList kSkippedTags = {"script", "style", "template", "title", "noscript"};
+
+    out.resize(0);
+    out.reserve(html.size() / 2);
+    PlainTextWriter writer(out);
+    int preformatted = 0;
+    const qsizetype n = html.size();
+    qsizetype i = 0;
+    while (i < n) {
+        const QChar ch = html[i];
+        if (ch == u'<') {
+            if (html.sliced(i).startsWith(u"<!--")) {
+                const qsizetype end = html.indexOf(u"-->", i + 4);
+                i = end < 0 ? n : end + 3;
+                continue;
+            }
+            qsizetype j = i + 1;
+            const bool closing = j < n && html[j] == u'/';
+            if (closing) {
+                ++j;
+            }
+            if (j < n && (html[j].isLetter() || html[j] == u'!' || html[j] == u'?')) {
+                const qsizetype nameStart = j;
+                while (j < n && isTagNameChar(html[j])) {
+                    ++j;
+                }
+                const QStringView name = html.mid(nameStart, j - nameStart);
+                // Skip attributes; '>' inside quoted values does not end the tag.
+                // A quote only opens a value right after '=' (whitespace
+                // allowed), so a stray apostrophe in a name is not a value.
+                char16_t quote = 0;
+                bool afterEquals = false;
+                while (j < n) {
+                    const char16_t c = html[j].unicode();
+                    if (quote != 0) {
+                        if (c == quote) {
+                            quote = 0;
+                        }
+                    } else if (c == u'>') {
+                        break;
+                    } else if (afterEquals && (c == u'"' || c == u'\'')) {
+                        quote = c;
+                        afterEquals = false;
+                    } else if (c == u'=') {
+                        afterEquals = true;
+                    } else if (!QChar::isSpace(c)) {
+                        afterEquals = false;
+                    }
+                    ++j;
+                }
+                i = j < n ? j + 1 : n;
+
+                if (kParagraphTags.contains(name, Qt::CaseInsensitive)) {
+                    writer.block(2);
+                } else if (kBlockTags.contains(name, Qt::CaseInsensitive)) {
+                    writer.block(1);
+                } else if (!closing && name.compare(u"br", Qt::CaseInsensitive) == 0) {
+                    writer.lineBreak();
+                } else if (!closing && (name.compare(u"td", Qt::CaseInsensitive) == 0
+                                        || name.compare(u"th", Qt::CaseInsensitive) == 0)) {
+                    writer.cell();
+                }
+                if (name.compare(u"pre", Qt::CaseInsensitive) == 0
+                    || name.compare(u"textarea", Qt::CaseInsensitive) == 0) {
+                    preformatted = qMax(0, preformatted + (closing ? -1 : 1));
+                }
+                if (!closing && kSkippedTags.contains(name, Qt::CaseInsensitive)) {
+                    // Raw text up to the matching end tag, which the next
+                    // iteration then parses as a normal tag.
+                    const QString endTag = QStringLiteral("</") + name.toString();
+                    const qsizetype end = html.indexOf(endTag, i, Qt::CaseInsensitive);
+                    i = end < 0 ? n : end;
+                }
+                continue;
+            }
+        } else if (ch == u'&') {
+            const char32_t decoded = decodeEntity(html, i);
+            if (decoded != 0) {
+                // Entities are literal text; &nbsp; in particular never collapses.
+                writer.character(decoded == 0x00A0 ? U' ' : decoded, true);
+                continue;
+            }
+        }
+        if (ch.isHighSurrogate() && i + 1 < n && html[i + 1].isLowSurrogate()) {
+            writer.character(QChar::surrogateToUcs4(ch, html[i + 1]), preformatted > 0);
+            i += 2;
+            continue;
+        }
+        writer.character(ch.unicode(), preformatted > 0);
+        ++i;
+    }
+}
+
+Transform transformByName(QStringView name) {
+    const QString key = name.trimmed().toString().toLower();
+    if (key == u"upper" || key == u"uppercase") {
+        return toUpper;
+    }
+    if (key == u"lower" || key == u"lowercase") {
+        return toLower;
+    }
+    if (key == u"title" || key == u"titlecase") {
+        return toTitleCase;
+    }
+    if (key == u"normalize") {
+        return normalizeWhitespace;
+    }
+    if (key == u"copy") {
+        return copy;
+    }
+    return nullptr;
+}
+
+} // namespace selaction::text
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QList>
+#include <QString>
+#include <QStringView>
+
+// Text transforms shared by the selaction popup, batch mode and other tools.
+// Only QtCore is required. Every transform reads a QStringView and writes its
+// result into a caller-owned buffer, replacing its contents, so callers that
+// loop can reuse one allocation.
+namespace selaction::text {
+
+using Transform = void (*)(QStringView in, QString &out);
+
+void copy(QStringView in, QString &out);
+void toUpper(QStringView in, QString &out);
+void toLower(QStringView in, QString &out);
+// Collapses each whitespace run to one space and trims both ends.
+void normalizeWhitespace(QStringView in, QString &out);
+// Normalizes whitespace, then capitalizes each word and lowercases the rest.
+void toTitleCase(QStringView in, QString &out);
+
+// Renders HTML as plain text in a single pass without building a tree: block
+// elements become line breaks, table cells tabs, entities are decoded and
+// script/style content is dropped.
+void htmlToPlainText(QStringView html, QString &out);
+
+// Byte codecs. Encoders always succeed. Decoders are strict: they return
+// false on any malformed input, and out is then unspecified. Base64 and hex
+// decoding skip ASCII whitespace so wrapped input works; Base64 accepts the
+// standard and the URL-safe alphabet, with or without padding.
+void base64Encode(QByteArrayView in, QByteArray &out);
+bool base64Decode(QByteArrayView in, QByteArray &out);
+// On x86 the Base64 loops use the widest vector kernel the CPU supports,
+// picked once at run time. Tests name a kernel to check each against the
+// scalar one; a kernel the CPU lacks runs as Scalar.
+enum class Base64Kernel { Scalar, Ssse3, Avx2 };
+QList<Base64Kernel> supportedBase64Kernels();
+void base64Encode(QByteArrayView in, QByteArray &out, Base64Kernel kernel);
+bool base64Decode(QByteArrayView in, QByteArray &out, Base64Kernel kernel);
+void hexEncode(QByteArrayView in, QByteArray &out);
+bool hexDecode(QByteArrayView in, QByteArray &out);
+// RFC 3986: everything but unreserved characters is percent-encoded. '+' is
+// left alone when decoding.
+void percentEncode(QByteArrayView in, QByteArray &out);
+bool percentDecode(QByteArrayView in, QByteArray &out);
+
+// Looks up a transform by its batch name ("upper", "title", ...); nullptr if unknown.
+Transform transformByName(QStringView name);
+
+inline QString apply(Transform transform, QStringView in) {
+    QString out;
+    transform(in, out);
+    return out;
+}
+
+} // namespace selaction::text
@@ -0,0 +1,375 @@
+#include "selaction_history.h"
+
+#include <QElapsedTimer>
+#include <QTest>
+
+#include <algorithm>
+#include <limits>
+
+using namespace selaction::text;
+
+namespace {
+
+// Deterministic lowercase words, long enough to span many chunks.
+QByteArray words(qsizetype size, quint32 seed) {
+    QByteArray text;
+    text.reserve(size);
+    quint32 state = seed;
+    while (text.size() < size) {
+        state = state * 1664525u + 1013904223u;
+        const int length = 2 + int((state >> 24) % 8);
+        for (int i = 0; i < length; ++i) {
+            state = state * 1664525u + 1013904223u;
+            text.append(char('a' + (state >> 24) % 26));
+        }
+        text.append(' ');
+    }
+    text.truncate(size);
+    return text;
+}
+
+// Every chunk lands in the same probe chain.
+quint64 collidingHash(QByteArrayView) {
+    return 42;
+}
+
+// A history with its search index attached the way the daemon wires them.
+struct SearchableHistory {
+    explicit SearchableHistory(qsizetype budget) {
+        history.setOnAdded([this](quint64 fingerprint, QByteArrayView utf8) { index.add(fingerprint, utf8); });
+        history.setOnRemoved([this](quint64 fingerprint) { index.remove(fingerprint); });
+        history.setByteBudget(budget);
+    }
+    SearchableHistory(const SearchableHistory &) = delete;
+    SearchableHistory &operator=(const SearchableHistory &) = delete;
+
+    ClipboardHistory history;
+    HistorySearchIndex index;
+};
+
+} // namespace
+
+class TestSelactionHistory : public QObject {
+    Q_OBJECT
+
+private slots:
+    void fingerprint();
+    void chunks();
+    void dedup();
+    void refresh();
+    void eviction();
+    void collision();
+    void searchRanking();
+    void searchReachesOldEntries();
+    void searchLongEntries();
+    void searchFollowsEviction();
+    void searchAfterReuse();
+    void searchLatency();
+};
+
+void TestSelactionHistory::fingerprint() {
+    // FNV-1a 64 reference values; fingerprints are persisted, so they must not change.
+    QCOMPARE(textFingerprint(""), Q_UINT64_C(0xcbf29ce484222325));
+    QCOMPARE(textFingerprint("a"), Q_UINT64_C(0xaf63dc4c8601ec8c));
+    QCOMPARE(textFingerprint("foobar"), Q_UINT64_C(0x85944171f73967e8));
+}
+
+void TestSelactionHistory::chunks() {
+    const QByteArray text = words(100000, 1);
+    const QList<ChunkSpan> spans = contentDefinedChunks(text);
+    QVERIFY(spans.size() > 10);
+    qsizetype offset = 0;
+    for (qsizetype i = 0; i < spans.size(); ++i) {
+        QCOMPARE(spans[i].offset, offset);
+        QVERIFY(spans[i].length <= 8192);
+        if (i + 1 < spans.size()) {
+            QVERIFY(spans[i].length > 512);
+        }
+        offset += spans[i].length;
+    }
+    QCOMPARE(offset, text.size());
+
+    // An edit in the middle leaves the chunks before it, and after it once the
+    // boundaries resynchronize, unchanged.
+    QByteArray edited = text;
+    edited[50000] = '#';
+    const QList<ChunkSpan> editedSpans = contentDefinedChunks(edited);
+    int changed = 0;
+    for (const ChunkSpan &span : editedSpans) {
+        const bool kept = std::any_of(spans.begin(), spans.end(), [&](const ChunkSpan &original) {
+            return original.offset == span.offset && original.length == span.length;
+        });
+        changed += kept ? 0 : 1;
+    }
+    QVERIFY(changed <= 2);
+}
+
+void TestSelactionHistory::dedup() {
+    ClipboardHistory history;
+    history.setByteBudget(1024 * 1024);
+    const QByteArray first = words(64 * 1024, 2);
+    QByteArray second = first;
+    second.insert(30000, "inserted words ");
+
+    const quint64 a = history.add(first, 1);
+    const quint64 b = history.add(second, 2);
+    QVERIFY(a != 0 && b != 0 && a != b);
+    QCOMPARE(history.utf8(a), first);
+    QCOMPARE(history.utf8(b), second);
+
+    const ClipboardHistory::Stats stats = history.stats();
+    QCOMPARE(stats.entries, 2);
+    QCOMPARE(stats.logicalBytes, first.size() + second.size());
+    // Only the chunks around the insertion are stored twice.
+    QVERIFY2(stats.storedBytes < first.size() + 2 * 8192, qPrintable(QString::number(stats.storedBytes)));
+    QVERIFY(stats.dedupRatio() > 1.7);
+}
+
+void TestSelactionHistory::refresh() {
+    ClipboardHistory history;
+    history.setByteBudget(1024 * 1024);
+    const quint64 a = history.add(QByteArray("first"), 1);
+    const quint64 b = history.add(QByteArray("second"), 2);
+    QCOMPARE(history.recent(2), QList<quint64>({b, a}));
+
+    const ClipboardHistory::Stats before = history.stats();
+    QCOMPARE(history.add(QByteArray("first"), 3), a);
+    QCOMPARE(history.recent(2), QList<quint64>({a, b}));
+    QCOMPARE(history.timestamp(a), qint64(3));
+    QCOMPARE(history.stats().storedBytes, before.storedBytes);
+    QCOMPARE(history.stats().chunks, before.chunks);
+}
+
+void TestSelactionHistory::eviction() {
+    constexpr qsizetype kBudget = 64 * 1024;
+    ClipboardHistory history;
+    history.setByteBudget(kBudget);
+    QList<quint64> added;
+    for (int i = 0; i < 200; ++i) {
+        added.append(history.add(words(1000, 100 + i), i + 1));
+        QVERIFY(added.last() != 0);
+        QVERIFY(history.stats().chargedBytes() <= kBudget);
+    }
+    // Least recently used entries went first; the newest ones are intact.
+    QVERIFY(history.size() < 200);
+    QVERIFY(!history.contains(added.first()));
+    const QList<quint64> recent = history.recent(history.size());
+    for (int i = 0; i < recent.size(); ++i) {
+        QCOMPARE(recent[i], added[added.size() - 1 - i]);
+        QCOMPARE(history.utf8(recent[i]), words(1000, 100 + 199 - i));
+    }
+
+    // Too large for the budget on its own.
+    QCOMPARE(history.add(words(kBudget, 7)), quint64(0));
+
+    // Shrinking the budget evicts down to it.
+    history.setByteBudget(kBudget / 4);
+    QVERIFY(history.stats().chargedBytes() <= kBudget / 4);
+    QCOMPARE(history.recent(1).value(0), added.last());
+    history.setByteBudget(0);
+    QCOMPARE(history.size(), 0);
+    QCOMPARE(history.stats().chargedBytes(), qsizetype(0));
+}
+
+void TestSelactionHistory::collision() {
+    // Three consecutive chunks of one text; each is also a text of its own whose
+    // only chunk is exactly that piece.
+    const QByteArray source = words(40000, 3);
+    const QList<ChunkSpan> spans = contentDefinedChunks(source);
+    QVERIFY(spans.size() >= 3);
+    const QByteArray first = source.sliced(spans[0].offset, spans[0].length);
+    const QByteArray second = source.sliced(spans[1].offset, spans[1].length);
+    const QByteArray third = source.sliced(spans[2].offset, spans[2].length);
+
+    ClipboardHistory history(collidingHash);
+    history.setByteBudget(1024 * 1024);
+    const quint64 a = history.add(first, 1);
+    const quint64 b = history.add(second, 2);
+    QCOMPARE(history.stats().chunks, 2);
+    QCOMPARE(history.utf8(a), first);
+    QCOMPARE(history.utf8(b), second);
+
+    // Evict the entry holding the head of the probe chain.
+    QCOMPARE(history.add(second, 3), b);
+    history.setByteBudget(history.stats().chargedBytes() - 1);
+    QVERIFY(!history.contains(a));
+    QVERIFY(history.contains(b));
+    QCOMPARE(history.stats().chunks, 1);
+
+    // The second piece is still found behind the freed slot, not stored
+    // again, and the third piece takes the freed slot.
+    history.setByteBudget(1024 * 1024);
+    const quint64 c = history.add(second + third, 4);
+    QCOMPARE(history.stats().chunks, 2);
+    QCOMPARE(history.stats().storedBytes, second.size() + third.size());
+    QCOMPARE(history.utf8(b), second);
+    QCOMPARE(history.utf8(c), second + third);
+
+    // Further colliding bytes go to the end of the chain.
+    const quint64 d = history.add(first, 5);
+    QCOMPARE(history.stats().chunks, 3);
+    QCOMPARE(history.utf8(d), first);
+    QCOMPARE(history.utf8(c), second + third);
+}
+
+void TestSelactionHistory::searchRanking() {
+    SearchableHistory searchable(1024 * 1024);
+    ClipboardHistory &history = searchable.history;
+    const HistorySearchIndex &index = searchable.index;
+
+    const quint64 fuzzy = history.add(QByteArray("f-o-o"), 1);
+    const quint64 inner = history.add(QByteArray("barfoo"), 2);
+    const quint64 word = history.add(QByteArray("xx Foo"), 3);
+    const quint64 start = history.add(QByteArray("foo bar"), 4);
+    const quint64 older = history.add(QByteArray("foo baz"), 5);
+    const quint64 newer = history.add(QByteArray("foo qux"), 6);
+    history.add(QByteArray("unrelated"), 7);
+
+    HistorySearchIndex::SearchStats stats;
+    const QList<HistorySearchIndex::Match> matches = index.search(QStringLiteral("FOO"), 10, history, &stats);
+    QList<quint64> order;
+    for (const HistorySearchIndex::Match &match : matches) {
+        order.append(match.fingerprint);
+    }
+    // Start of text first, ties broken by recency, then word starts, then
+    // inner substrings; the fuzzy match ranks last.
+    QCOMPARE(order, QList<quint64>({newer, older, start, word, inner, fuzzy}));
+    QVERIFY(matches[4].score > matches[5].score);
+    QVERIFY(stats.fuzzyScanned > 0);
+
+    // All terms must match.
+    const QList<HistorySearchIndex::Match> both = index.search(QStringLiteral("bar foo"), 10, history);
+    QCOMPARE(both.size(), 2);
+    QCOMPARE(both[0].fingerprint, start);
+    QCOMPARE(both[1].fingerprint, inner);
+
+    QVERIFY(index.search(QStringLiteral("   "), 10, history).isEmpty());
+    QCOMPARE(index.search(QStringLiteral("foo"), 2, history).size(), 2);
+}
+
+void TestSelactionHistory::searchReachesOldEntries() {
+    SearchableHistory searchable(4 * 1024 * 1024);
+    ClipboardHistory &history = searchable.history;
+    const HistorySearchIndex &index = searchable.index;
+
+    const quint64 oldest = history.add(QByteArray("Kubernetes q7 rollout"), 1);
+    for (int i = 0; i < 1000; ++i) {
+        history.add(QByteArray("filler entry ") + QByteArray::number(i), i + 2);
+    }
+    // A two-byte term is found by its pair and a fuzzy term by scanning; both
+    // reach past the newest entries.
+    const QList<HistorySearchIndex::Match> shortTerm = index.search(QStringLiteral("q7"), 10, history);
+    QCOMPARE(shortTerm.size(), 1);
+    QCOMPARE(shortTerm[0].fingerprint, oldest);
+    const QList<HistorySearchIndex::Match> fuzzyTerm = index.search(QStringLiteral("kbrnts"), 10, history);
+    QCOMPARE(fuzzyTerm.size(), 1);
+    QCOMPARE(fuzzyTerm[0].fingerprint, oldest);
+}
+
+void TestSelactionHistory::searchLongEntries() {
+    SearchableHistory searchable(4 * 1024 * 1024);
+    ClipboardHistory &history = searchable.history;
+    const HistorySearchIndex &index = searchable.index;
+
+    // Past the indexed prefix and split over many chunks.
+    const QByteArray text = words(200 * 1024, 5) + " trailing marker";
+    const quint64 fingerprint = history.add(text, 1);
+    history.add(QByteArray("marker in a short entry"), 2);
+    const QList<HistorySearchIndex::Match> matches = index.search(QStringLiteral("trailing marker"), 10, history);
+    QCOMPARE(matches.size(), 1);
+    QCOMPARE(matches[0].fingerprint, fingerprint);
+}
+
+void TestSelactionHistory::searchFollowsEviction() {
+    SearchableHistory searchable(1024 * 1024);
+    ClipboardHistory &history = searchable.history;
+    const HistorySearchIndex &index = searchable.index;
+
+    const quint64 gone = history.add(QByteArray("needle in a haystack"), 1);
+    const quint64 kept = history.add(QByteArray("another needle"), 2);
+    QCOMPARE(index.size(), 2);
+    history.setByteBudget(history.stats().chargedBytes() - 1);
+    QVERIFY(!history.contains(gone));
+    QCOMPARE(index.size(), 1);
+
+    const QList<HistorySearchIndex::Match> matches = index.search(QStringLiteral("needle"), 10, history);
+    QCOMPARE(matches.size(), 1);
+    QCOMPARE(matches[0].fingerprint, kept);
+    QVERIFY(index.search(QStringLiteral("haystack"), 10, history).isEmpty());
+    QVERIFY(index.search(QStringLiteral("hystck"), 10, history).isEmpty());
+}
+
+void TestSelactionHistory::searchAfterReuse() {
+    SearchableHistory searchable(4 * 1024 * 1024);
+    ClipboardHistory &history = searchable.history;
+    const HistorySearchIndex &index = searchable.index;
+
+    const quint64 first = history.add(QByteArray("same score one"), 1);
+    const quint64 second = history.add(QByteArray("same score two"), 2);
+    // Copying the older text again makes it the more recent of the tie.
+    QCOMPARE(history.add(QByteArray("same score one"), 3), first);
+    QList<HistorySearchIndex::Match> matches = index.search(QStringLiteral("same"), 10, history);
+    QCOMPARE(matches.size(), 2);
+    QCOMPARE(matches[0].fingerprint, first);
+    QCOMPARE(matches[1].fingerprint, second);
+
+    // Enough reuse for the index to compact its slots; nothing is lost.
+    for (int round = 0; round < 3; ++round) {
+        for (int i = 0; i < 1000; ++i) {
+            history.add(QByteArray("churn entry ") + QByteArray::number(i), 10 + round * 1000 + i);
+        }
+    }
+    QCOMPARE(index.size(), 1002);
+    matches = index.search(QStringLiteral("churn 999"), 10, history);
+    QCOMPARE(matches.size(), 1);
+    QCOMPARE(matches[0].timestampMs, qint64(3009));
+    matches = index.search(QStringLiteral("same"), 10, history);
+    QCOMPARE(matches.size(), 2);
+    QCOMPARE(matches[0].fingerprint, first);
+    QCOMPARE(index.search(QStringLiteral("entry"), 2000, history).size(), 1000);
+}
+
+void TestSelactionHistory::searchLatency() {
+#if !defined(NDEBUG)
+    QSKIP("Search latency is only asserted in optimized builds");
+#else
+    constexpr int kEntries = 50000;
+    constexpr qint64 kMaxSearchUs = 5000;
+    SearchableHistory searchable(256 * 1024 * 1024);
+    ClipboardHistory &history = searchable.history;
+    const HistorySearchIndex &index = searchable.index;
+    for (int i = 0; i < kEntries; ++i) {
+        QByteArray text = words(40 + i % 160, 1000 + i);
+        if (i % 1000 == 0) {
+            text += " release notes " + QByteArray::number(i / 1000);
+        }
+        history.add(text, i + 1);
+    }
+    QCOMPARE(index.size(), kEntries);
+
+    const QStringList queries = {
+        QStringLiteral("release notes"), // trigram candidates
+        QStringLiteral("notes 7"),       // trigram and a short term
+        QStringLiteral("qz"),            // short term, prefiltered scan
+        QStringLiteral("a"),             // matches nearly every entry
+        QStringLiteral("rlsnts"),        // fuzzy only
+        QStringLiteral("xyzzyq"),        // no match
+    };
+    for (const QString &query : queries) {
+        qint64 bestUs = std::numeric_limits<qint64>::max();
+        int matches = 0;
+        for (int run = 0; run < 5; ++run) {
+            QElapsedTimer timer;
+            timer.start();
+            matches = index.search(query, 50, history).size();
+            bestUs = qMin(bestUs, timer.nsecsElapsed() / 1000);
+        }
+        qInfo() << "query" << query << "matches" << matches << "us" << bestUs;
+        QVERIFY2(bestUs < kMaxSearchUs, qPrintable(QStringLiteral("%1 took %2 us").arg(query).arg(bestUs)));
+    }
+#endif
+}
+
+QTEST_APPLESS_MAIN(TestSelactionHistory)
+
+#include "tst_selaction_history.moc"
@@ -0,0 +1,459 @@
+#include "selaction_digest.h"
+#include "selaction_json.h"
+#include "selaction_text.h"
+
+#include <QTest>
+
+using namespace selaction::text;
+
+namespace {
+
+// Deterministic bytes covering every value, for inputs longer than a literal.
+QByteArray pattern(qsizetype size) {
+    QByteArray data(size, Qt::Uninitialized);
+    for (qsizetype i = 0; i < size; ++i) {
+        data[i] = char((i * 37 + 11) & 0xFF);
+    }
+    return data;
+}
+
+const char *kernelName(Base64Kernel kernel) {
+    switch (kernel) {
+    case Base64Kernel::Scalar:
+        return "scalar";
+    case Base64Kernel::Ssse3:
+        return "ssse3";
+    case Base64Kernel::Avx2:
+        return "avx2";
+    }
+    return "?";
+}
+
+} // namespace
+
+class TestSelactionText : public QObject {
+    Q_OBJECT
+
+private slots:
+    void transforms_data();
+    void transforms();
+    void unknownTransform();
+    void reusedBuffer();
+    void htmlToPlainText_data();
+    void htmlToPlainText();
+    void base64_data();
+    void base64();
+    void codecSweep_data();
+    void codecSweep();
+    void decodeAccepts_data();
+    void decodeAccepts();
+    void decodeRejects_data();
+    void decodeRejects();
+    void digests_data();
+    void digests();
+    void digestSubset();
+    void digestChunked();
+    void jsonFormat_data();
+    void jsonFormat();
+    void jsonErrors_data();
+    void jsonErrors();
+};
+
+void TestSelactionText::transforms_data() {
+    QTest::addColumn<QString>("name");
+    QTest::addColumn<QString>("input");
+    QTest::addColumn<QString>("expected");
+
+    QTest::newRow("upper") << "upper" << QStringLiteral("héllo wörld") << QStringLiteral("HÉLLO WÖRLD");
+    QTest::newRow("lower") << "Lowercase" << QStringLiteral("HÉLLO") << QStringLiteral("héllo");
+    QTest::newRow("normalize") << "normalize" << "  a \t b\n\nc  " << "a b c";
+    QTest::newRow("normalize empty") << "normalize" << " \n\t " << "";
+    QTest::newRow("title") << "title" << "  hELLO   wORLD " << "Hello World";
+    // U+10428 DESERET SMALL LETTER LONG I uppercases to U+10400 across a surrogate pair.
+    QTest::newRow("title surrogate") << "titlecase" << QStringLiteral("\U00010428x \U00010428Y")
+                                     << QStringLiteral("\U00010400x \U00010400y");
+    QTest::newRow("copy") << " copy " << "as is " << "as is ";
+}
+
+void TestSelactionText::transforms() {
+    QFETCH(QString, name);
+    QFETCH(QString, input);
+    QFETCH(QString, expected);
+
+    const Transform transform = transformByName(name);
+    QVERIFY(transform);
+    QCOMPARE(apply(transform, input), expected);
+}
+
+void TestSelactionText::unknownTransform() {
+    QVERIFY(!transformByName(u"reverse"));
+    QVERIFY(!transformByName(u""));
+}
+
+void TestSelactionText::reusedBuffer() {
+    // Transforms replace the buffer's contents rather than appending.
+    QString out = QStringLiteral("stale contents");
+    toUpper(u"ab", out);
+    QCOMPARE(out, QStringLiteral("AB"));
+    normalizeWhitespace(u" ", out);
+    QCOMPARE(out, QString());
+}
+
+void TestSelactionText::htmlToPlainText_data() {
+    QTest::addColumn<QString>("html");
+    QTest::addColumn<QString>("expected");
+
+    QTest::newRow("paragraphs") << "<p>One</p>\n<p>Two</p>" << "One\n\nTwo";
+    QTest::newRow("collapse") << "  a \n\t b  " << "a b";
+    QTest::newRow("line breaks") << "a<br>b<br><br><br>c" << "a\nb\n\nc";
+    QTest::newRow("table") << "<table><tr><td>a</td><td>b</td></tr><tr><td>c</td></tr></table>" << "a\tb\nc";
+    QTest::newRow("pre") << "<pre>  x\n  y</pre>z" << "  x\n  y\n\nz";
+    QTest::newRow("entities") << "Fish &amp; chips&nbsp;&nbsp;&#x263A; &bogus; &#xD800;"
+                              << QStringLiteral("Fish & chips  \u263A &bogus; &#xD800;");
+    QTest::newRow("script") << "a<script>if (x < y) {}</script>b" << "ab";
+    QTest::newRow("comment") << "a<!-- <p> -->b" << "ab";
+    QTest::newRow("quoted >") << "<a title=\"1 > 0\" href='x'>link</a>" << "link";
+    QTest::newRow("spaced quote") << "<p class = \"a>b\">x</p>" << "x";
+    // Only a quote after '=' opens a value, so the apostrophe does not swallow the text.
+    QTest::newRow("stray apostrophe") << "<img alt=Bob's>text <b it's>bold</b>" << "text bold";
+}
+
+void TestSelactionText::htmlToPlainText() {
+    QFETCH(QString, html);
+    QFETCH(QString, expected);
+
+    QString out;
+    selaction::text::htmlToPlainText(html, out);
+    QCOMPARE(out, expected);
+}
+
+void TestSelactionText::base64_data() {
+    QTest::addColumn<QByteArray>("plain");
+    QTest::addColumn<QByteArray>("encoded");
+
+    // RFC 4648 test vectors cover every scalar tail.
+    QTest::newRow("empty") << QByteArray() << QByteArray();
+    QTest::newRow("f") << QByteArray("f") << QByteArray("Zg==");
+    QTest::newRow("fo") << QByteArray("fo") << QByteArray("Zm8=");
+    QTest::newRow("foo") << QByteArray("foo") << QByteArray("Zm9v");
+    QTest::newRow("foob") << QByteArray("foob") << QByteArray("Zm9vYg==");
+    QTest::newRow("fooba") << QByteArray("fooba") << QByteArray("Zm9vYmE=");
+    QTest::newRow("foobar") << QByteArray("foobar") << QByteArray("Zm9vYmFy");
+    // Long enough for one AVX2 and one SSSE3 step, then scalar quanta and a
+    // padded tail.
+    QTest::newRow("fox") << QByteArray("The quick brown fox jumps over the lazy dog")
+                         << QByteArray("VGhlIHF1aWNrIGJyb3duIGZveCBqdW1wcyBvdmVyIHRoZSBsYXp5IGRvZw==");
+}
+
+void TestSelactionText::base64() {
+    QFETCH(QByteArray, plain);
+    QFETCH(QByteArray, encoded);
+
+    QByteArray out;
+    base64Encode(plain, out);
+    QCOMPARE(out, encoded);
+    QVERIFY(base64Decode(encoded, out));
+    QCOMPARE(out, plain);
+    for (const Base64Kernel kernel : supportedBase64Kernels()) {
+        base64Encode(plain, out, kernel);
+        QCOMPARE(out, encoded);
+        QVERIFY(base64Decode(encoded, out, kernel));
+        QCOMPARE(out, plain);
+    }
+}
+
+void TestSelactionText::codecSweep_data() {
+    QTest::addColumn<int>("kernel");
+
+    // One row per Base64 kernel this CPU can run.
+    for (const Base64Kernel kernel : supportedBase64Kernels()) {
+        QTest::newRow(kernelName(kernel)) << int(kernel);
+    }
+}
+
+void TestSelactionText::codecSweep() {
+    QFETCH(int, kernel);
+    const Base64Kernel base64Kernel = static_cast<Base64Kernel>(kernel);
+
+    // Every length up to several AVX2 steps, so each vector/scalar split is
+    // checked against QByteArray's own codecs.
+    QByteArray data;
+    QByteArray out;
+    for (int n = 0; n <= 200; ++n) {
+        const QByteArray base64 = data.toBase64();
+        base64Encode(data, out, base64Kernel);
+        QCOMPARE(out, base64);
+        QVERIFY(base64Decode(base64, out, base64Kernel));
+        QCOMPARE(out, data);
+        const QByteArray base64Url = data.toBase64(QByteArray::Base64UrlEncoding | QByteArray::OmitTrailingEquals);
+        QVERIFY(base64Decode(base64Url, out, base64Kernel));
+        QCOMPARE(out, data);
+
+        hexEncode(data, out);
+        QCOMPARE(out, data.toHex());
+        QVERIFY(hexDecode(data.toHex().toUpper(), out));
+        QCOMPARE(out, data);
+
+        const QByteArray percent = data.toPercentEncoding();
+        percentEncode(data, out);
+        QCOMPARE(out, percent);
+        QVERIFY(percentDecode(percent, out));
+        QCOMPARE(out, data);
+
+        data.append(char((n * 37 + 11) & 0xFF));
+    }
+
+    // A bad character anywhere, in a vector block or in the scalar tail, is
+    // rejected.
+    const QByteArray base64 = pattern(120).toBase64();
+    for (qsizetype i = 0; i < base64.size() - 2; ++i) {
+        QByteArray corrupt = base64;
+        corrupt[i] = '*';
+        QVERIFY2(!base64Decode(corrupt, out, base64Kernel), qPrintable(QString::number(i)));
+    }
+}
+
+void TestSelactionText::decodeAccepts_data() {
+    QTest::addColumn<QString>("codec");
+    QTest::addColumn<QByteArray>("input");
+    QTest::addColumn<QByteArray>("expected");
+
+    QTest::newRow("base64 unpadded") << "base64" << QByteArray("Zm9vYg") << QByteArray("foob");
+    QTest::newRow("base64 wrapped") << "base64" << QByteArray(" Zm9v\nYmFy\r\n") << QByteArray("foobar");
+    QTest::newRow("base64 url-safe") << "base64" << QByteArray("-_8=") << QByteArray("\xFB\xFF");
+    QTest::newRow("base64 standard") << "base64" << QByteArray("+/8") << QByteArray("\xFB\xFF");
+    QTest::newRow("base64 two blocks") << "base64" << QByteArray("QUJDREVGR0hJSktMTU5PUFFSU1RVVldY")
+                                       << QByteArray("ABCDEFGHIJKLMNOPQRSTUVWX");
+    QTest::newRow("hex mixed case") << "hex" << QByteArray("0001ABff") << QByteArray("\x00\x01\xAB\xFF", 4);
+    QTest::newRow("hex spaced") << "hex" << QByteArray("41 42\n43") << QByteArray("ABC");
+    QTest::newRow("percent utf-8") << "percent" << QByteArray("%E2%82%AC") << QByteArray("\xE2\x82\xAC");
+    QTest::newRow("percent plus") << "percent" << QByteArray("a+b") << QByteArray("a+b");
+    QTest::newRow("percent case") << "percent" << QByteArray("%41%4a%4A") << QByteArray("AJJ");
+}
+
+void TestSelactionText::decodeAccepts() {
+    QFETCH(QString, codec);
+    QFETCH(QByteArray, input);
+    QFETCH(QByteArray, expected);
+
+    QByteArray out;
+    if (codec == u"base64") {
+        QVERIFY(base64Decode(input, out));
+    } else if (codec == u"hex") {
+        QVERIFY(hexDecode(input, out));
+    } else {
+        QVERIFY(percentDecode(input, out));
+    }
+    QCOMPARE(out, expected);
+}
+
+void TestSelactionText::decodeRejects_data() {
+    QTest::addColumn<QString>("codec");
+    QTest::addColumn<QByteArray>("input");
+
+    QTest::newRow("base64 short padding") << "base64" << QByteArray("Zg=");
+    QTest::newRow("base64 inner padding") << "base64" << QByteArray("Zg=a");
+    QTest::newRow("base64 triple padding") << "base64" << QByteArray("Z===");
+    QTest::newRow("base64 padding mid-stream") << "base64" << QByteArray("Zg==Zg==");
+    // Nonzero bits past the last byte would give "f" and "fo" a second encoding.
+    QTest::newRow("base64 loose bits 1") << "base64" << QByteArray("Zh==");
+    QTest::newRow("base64 loose bits 2") << "base64" << QByteArray("Zm9=");
+    QTest::newRow("base64 dangling char") << "base64" << QByteArray("Zm9vY");
+    QTest::newRow("base64 bad char tail") << "base64" << QByteArray("Zm9v*A==");
+    QTest::newRow("base64 bad char block") << "base64" << QByteArray("QUJDREVGR0hJSktMTU5P*FFSU1RVVldY");
+    QTest::newRow("hex odd") << "hex" << QByteArray("abc");
+    QTest::newRow("hex bad char") << "hex" << QByteArray("0g");
+    QTest::newRow("percent bare") << "percent" << QByteArray("%");
+    QTest::newRow("percent short") << "percent" << QByteArray("abc%2");
+    QTest::newRow("percent bad digit") << "percent" << QByteArray("%zz");
+    QTest::newRow("percent doubled") << "percent" << QByteArray("%%41");
+}
+
+void TestSelactionText::decodeRejects() {
+    QFETCH(QString, codec);
+    QFETCH(QByteArray, input);
+
+    QByteArray out;
+    if (codec == u"base64") {
+        QVERIFY(!base64Decode(input, out));
+    } else if (codec == u"hex") {
+        QVERIFY(!hexDecode(input, out));
+    } else {
+        QVERIFY(!percentDecode(input, out));
+    }
+}
+
+void TestSelactionText::digests_data() {
+    QTest::addColumn<QByteArray>("input");
+    QTest::addColumn<QByteArray>("sha256");
+    QTest::addColumn<QByteArray>("sha1");
+    QTest::addColumn<QByteArray>("md5");
+    QTest::addColumn<QByteArray>("crc32");
+    QTest::addColumn<QByteArray>("xxh3");
+
+    QTest::newRow("empty") << QByteArray()
+                           << QByteArray("e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855")
+                           << QByteArray("da39a3ee5e6b4b0d3255bfef95601890afd80709")
+                           << QByteArray("d41d8cd98f00b204e9800998ecf8427e") << QByteArray("00000000")
+                           << QByteArray("2d06800538d394c2");
+    QTest::newRow("abc") << QByteArray("abc")
+                         << QByteArray("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad")
+                         << QByteArray("a9993e364706816aba3e25717850c26c9cd0d89d")
+                         << QByteArray("900150983cd24fb0d6963f7d28e17f72") << QByteArray("352441c2")
+                         << QByteArray("78af5f94892f3950");
+    // The CRC-32 check value; nine bytes run one slicing-by-8 step and one tail byte.
+    QTest::newRow("check") << QByteArray("123456789")
+                           << QByteArray("15e2b0d3c33891ebb0f1ef609ec419420c20e320ce94c65fbc8c3312448eb225")
+                           << QByteArray("f7c3bc1d808e04732adf679965ccc34ca7ae3441")
+                           << QByteArray("25f9e794323b453885f5181f1b624d0b") << QByteArray("cbf43926")
+                           << QByteArray("72dcb18b67a17dff");
+    // Several 64 KiB chunks and a short last one.
+    QTest::newRow("chunked") << pattern(200000)
+                             << QByteArray("9f9a45c0ba59beed18eb96b98804587ee6de0005b161c6da6bbb8f132d25fe73")
+                             << QByteArray("f4759abb46d70a165dc4dedba2d44aeb98a71d12")
+                             << QByteArray("0dc977606fabb61fbf84cef39d163779") << QByteArray("28d9adc7")
+                             << QByteArray("993b41c78a611079");
+}
+
+void TestSelactionText::digests() {
+    QFETCH(QByteArray, input);
+    QFETCH(QByteArray, sha256);
+    QFETCH(QByteArray, sha1);
+    QFETCH(QByteArray, md5);
+    QFETCH(QByteArray, crc32);
+    QFETCH(QByteArray, xxh3);
+
+    const QList<DigestResult> results = digest(input, AllDigests);
+    QCOMPARE(results.size(), 5);
+    QCOMPARE(results[0].name, QStringLiteral("SHA-256"));
+    QCOMPARE(results[0].hex, sha256);
+    QCOMPARE(results[1].name, QStringLiteral("SHA-1"));
+    QCOMPARE(results[1].hex, sha1);
+    QCOMPARE(results[2].name, QStringLiteral("MD5"));
+    QCOMPARE(results[2].hex, md5);
+    QCOMPARE(results[3].name, QStringLiteral("CRC32"));
+    QCOMPARE(results[3].hex, crc32);
+    QCOMPARE(results[4].name, QStringLiteral("XXH3"));
+    QCOMPARE(results[4].hex, xxh3);
+}
+
+void TestSelactionText::digestSubset() {
+    // Only the requested digests, still in enum order.
+    const QList<DigestResult> results = digest("123456789", Xxh3 | Crc32 | Md5);
+    QCOMPARE(results.size(), 3);
+    QCOMPARE(results[0].name, QStringLiteral("MD5"));
+    QCOMPARE(results[1].hex, QByteArray("cbf43926"));
+    QCOMPARE(results[2].hex, QByteArray("72dcb18b67a17dff"));
+    QVERIFY(digest("abc", 0).isEmpty());
+}
+
+void TestSelactionText::digestChunked() {
+    // Uneven pieces put the CRC slicing loop and the XXH3 stripe buffer at
+    // every alignment; the result must not depend on how data is split.
+    const QByteArray data = pattern(5000);
+    MultiHasher hasher(AllDigests);
+    qsizetype piece = 1;
+    for (qsizetype offset = 0; offset < data.size(); offset += piece, piece = piece % 13 + 1) {
+        hasher.addData(QByteArrayView(data).sliced(offset, qMin(piece, data.size() - offset)));
+    }
+    const QList<DigestResult> pieces = hasher.results();
+    const QList<DigestResult> whole = digest(data, AllDigests);
+    QCOMPARE(pieces.size(), whole.size());
+    for (qsizetype i = 0; i < whole.size(); ++i) {
+        QCOMPARE(pieces[i].name, whole[i].name);
+        QCOMPARE(pieces[i].hex, whole[i].hex);
+    }
+}
+
+void TestSelactionText::jsonFormat_data() {
+    QTest::addColumn<QByteArray>("input");
+    QTest::addColumn<bool>("pretty");
+    QTest::addColumn<int>("indent");
+    QTest::addColumn<bool>("sortKeys");
+    QTest::addColumn<QByteArray>("expected");
+
+    QTest::newRow("compact") << QByteArray(R"( {"k" : [ true , false , null , -0.5E+2 , "\"\n" ] } )") << false << 2
+                             << false << QByteArray(R"({"k":[true,false,null,-0.5E+2,"\"\n"]})");
+    QTest::newRow("pretty") << QByteArray(R"({"a":[1,{}],"b":"x"})") << true << 2 << false
+                            << QByteArray("{\n  \"a\": [\n    1,\n    {}\n  ],\n  \"b\": \"x\"\n}");
+    QTest::newRow("indent 4") << QByteArray(R"({"a":[1]})") << true << 4 << false
+                              << QByteArray("{\n    \"a\": [\n        1\n    ]\n}");
+    QTest::newRow("empty containers") << QByteArray(R"({"k":[]})") << true << 0 << false
+                                      << QByteArray("{\n\"k\": []\n}");
+    QTest::newRow("keep order") << QByteArray(R"({"b":1,"a":2})") << false << 2 << false
+                                << QByteArray(R"({"b":1,"a":2})");
+    QTest::newRow("sort nested") << QByteArray(R"({"b":1,"a":{"d":[{"y":1,"x":2}],"c":3}})") << false << 2 << true
+                                 << QByteArray(R"({"a":{"c":3,"d":[{"x":2,"y":1}]},"b":1})");
+    QTest::newRow("sort pretty") << QByteArray(R"({"b":1,"a":[1,2]})") << true << 2 << true
+                                 << QByteArray("{\n  \"a\": [\n    1,\n    2\n  ],\n  \"b\": 1\n}");
+    // Duplicate keys keep their input order.
+    QTest::newRow("sort duplicates") << QByteArray(R"({"a":1,"a":0})") << false << 2 << true
+                                     << QByteArray(R"({"a":1,"a":0})");
+    // Keys sort by code point, so U+1F600 follows U+FB01 although its UTF-16
+    // surrogates are smaller.
+    QTest::newRow("sort code points") << QByteArray(R"({"😀":1,"ﬁ":2,"b":3,"A":4,"a":5})") << false << 2 << true
+                                      << QByteArray(R"({"A":4,"a":5,"b":3,"ﬁ":2,"😀":1})");
+    // Escaped keys sort by what they decode to; a surrogate pair is one code point.
+    QTest::newRow("sort escaped") << QByteArray(R"({"\ud83d\ude00":1,"\ufb01":2,"b":3,"\u0041":4,"a":5})") << false << 2
+                                  << true << QByteArray(R"({"\u0041":4,"a":5,"b":3,"\ufb01":2,"\ud83d\ude00":1})");
+}
+
+void TestSelactionText::jsonFormat() {
+    QFETCH(QByteArray, input);
+    QFETCH(bool, pretty);
+    QFETCH(int, indent);
+    QFETCH(bool, sortKeys);
+    QFETCH(QByteArray, expected);
+
+    JsonFormatOptions options;
+    options.pretty = pretty;
+    options.indent = indent;
+    options.sortKeys = sortKeys;
+    QByteArray out;
+    const JsonError error = reformatJson(input, out, options);
+    QVERIFY2(error.ok(), qPrintable(error.message));
+    QCOMPARE(error.offset, qsizetype(-1));
+    QCOMPARE(out, expected);
+}
+
+void TestSelactionText::jsonErrors_data() {
+    QTest::addColumn<QByteArray>("input");
+    QTest::addColumn<qsizetype>("offset");
+    QTest::addColumn<QString>("message");
+
+    QTest::newRow("empty") << QByteArray() << qsizetype(0) << "Unexpected end of input";
+    QTest::newRow("blank") << QByteArray("   ") << qsizetype(3) << "Unexpected end of input";
+    QTest::newRow("unclosed array") << QByteArray("[1") << qsizetype(2) << "Unexpected end of input";
+    QTest::newRow("trailing comma") << QByteArray("[1,]") << qsizetype(3) << "Unexpected character";
+    QTest::newRow("trailing member") << QByteArray(R"({"a":1,})") << qsizetype(7) << "Expected an object key";
+    QTest::newRow("missing colon") << QByteArray(R"({"a" 1})") << qsizetype(5) << "Expected ':' after an object key";
+    QTest::newRow("leading zero") << QByteArray("[01]") << qsizetype(2) << "Expected ',' or ']'";
+    QTest::newRow("bare dot") << QByteArray("[1.]") << qsizetype(3) << "Invalid number";
+    QTest::newRow("bare minus") << QByteArray("-") << qsizetype(1) << "Invalid number";
+    QTest::newRow("bad literal") << QByteArray(R"({"a":tru})") << qsizetype(5) << "Unexpected character";
+    QTest::newRow("unterminated") << QByteArray(R"("abc)") << qsizetype(0) << "Unterminated string";
+    QTest::newRow("bad escape") << QByteArray(R"("\x")") << qsizetype(1) << "Invalid escape sequence";
+    QTest::newRow("raw tab") << QByteArray("\"a\tb\"") << qsizetype(2) << "Control character in string";
+    QTest::newRow("trailing data") << QByteArray("[1] x") << qsizetype(4) << "Unexpected data after the JSON value";
+    QTest::newRow("extra brace") << QByteArray(R"({"a":1}})") << qsizetype(7) << "Unexpected data after the JSON value";
+}
+
+void TestSelactionText::jsonErrors() {
+    QFETCH(QByteArray, input);
+    QFETCH(qsizetype, offset);
+    QFETCH(QString, message);
+
+    for (const bool sortKeys : {false, true}) {
+        JsonFormatOptions options;
+        options.sortKeys = sortKeys;
+        QByteArray out;
+        const JsonError error = reformatJson(input, out, options);
+        QVERIFY(!error.ok());
+        QCOMPARE(error.offset, offset);
+        QCOMPARE(error.message, message);
+    }
+}
+
+QTEST_APPLESS_MAIN(TestSelactionText)
+
+#include "tst_selaction_text.moc"